@@ -0,0 +1,340 @@
+// benchmark.cpp : Compares every table_adapter operator and dao::execute with the equivalent sqlite3 C API code.
+//
+// Built by the benchmark project of sqlite-dao.sln. On Linux, with the custom headers on the include path, e.g.
+//	g++ -std=c++14 -O2 -I<custom headers> benchmark.cpp -lsqlite3 -lboost_thread -lboost_filesystem -lboost_system -lpthread
+// Usage:
+//	benchmark [rows = 10000] [text columns = 4] [blob bytes = 256]
+//
+
+#include "sqlite.hpp"
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <new>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+using namespace sqlite_hsd;
+
+static std::atomic<uint64_t> g_allocations(0);
+
+//counts every allocation of the process. the replacements are kept out of line, so the compiler does not pair an
+//inlined malloc or free with a call to the operators it cannot see through.
+#ifdef _MSC_VER
+#define BENCHMARK_NOINLINE __declspec(noinline)
+#else
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+BENCHMARK_NOINLINE void* operator new(size_t size)
+{
+	++g_allocations;
+	if(void* p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+BENCHMARK_NOINLINE void* operator new[](size_t size) {return operator new(size);}
+BENCHMARK_NOINLINE void operator delete(void* p) noexcept {free(p);}
+BENCHMARK_NOINLINE void operator delete(void* p, size_t) noexcept {free(p);}
+BENCHMARK_NOINLINE void operator delete[](void* p) noexcept {free(p);}
+BENCHMARK_NOINLINE void operator delete[](void* p, size_t) noexcept {free(p);}
+
+struct settings
+{
+	size_t		rows;
+	size_t		text_columns;
+	size_t		blob_bytes;
+};
+
+struct measurement
+{
+	string			name;
+	vector<double>	latencies;
+	double			seconds;
+	uint64_t		allocations;
+};
+
+template<class Func>
+measurement measure(const string& name, size_t operations, Func operation)
+{
+	typedef std::chrono::steady_clock clock;
+	measurement m;
+	m.name = name;
+	m.latencies.reserve(operations);
+	uint64_t allocations = g_allocations;
+	auto started = clock::now();
+	for(size_t i = 0; i < operations; ++i)
+	{
+		auto begin = clock::now();
+		operation(i);
+		m.latencies.push_back(std::chrono::duration<double, std::micro>(clock::now() - begin).count());
+	}
+	m.seconds = std::chrono::duration<double>(clock::now() - started).count();
+	//the latency vector was reserved up front, so only the operations themselves are counted.
+	m.allocations = g_allocations - allocations;
+	return m;
+}
+
+void report(const measurement& m)
+{
+	auto latencies = m.latencies;
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&latencies](double p) {return latencies.empty() ? 0 : latencies[(size_t)(p * (latencies.size() - 1))];};
+	size_t operations = m.latencies.size();
+	cout << left << setw(28) << m.name << right
+		<< setw(14) << fixed << setprecision(0) << (m.seconds > 0 ? operations / m.seconds : 0)
+		<< setw(12) << setprecision(2) << percentile(0.5)
+		<< setw(12) << percentile(0.99)
+		<< setw(12) << setprecision(1) << (operations ? (double)m.allocations / operations : 0) << endl;
+}
+
+//the time stamp counter where there is one, nanoseconds elsewhere.
+uint64_t cycles()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void report_cells(const string& name, uint64_t elapsed, uint64_t cells)
+{
+	cout << left << setw(28) << name << right << setw(14) << fixed << setprecision(1) << (cells ? (double)elapsed / cells : 0) << " cycles/cell" << endl;
+}
+
+class raw_statement
+{
+private:
+	sqlite3_stmt*	m_stmt;
+public:
+	raw_statement(sqlite3* db, const char* sql) : m_stmt(nullptr) {sqlite3_prepare(db, sql, -1, &m_stmt, nullptr);}
+	~raw_statement() {sqlite3_finalize(m_stmt);}
+	operator sqlite3_stmt*()const {return m_stmt;}
+};
+
+int main(int argc, char* argv[])
+{
+	settings s = {10000, 4, 256};
+	if(argc > 1) s.rows = strtoul(argv[1], nullptr, 10);
+	if(argc > 2) s.text_columns = strtoul(argv[2], nullptr, 10);
+	if(argc > 3) s.blob_bytes = strtoul(argv[3], nullptr, 10);
+
+	auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sqlite-dao-%%%%%%%%.db");
+	auto d = make_shared<dao>();
+	d->open(path);
+	d->execute(wstring(L"pragma synchronous=off"));
+
+	vector<wstring> columns;
+	wstring schema = L"id integer primary key";
+	for(size_t c = 0; c < s.text_columns; ++c)
+	{
+		columns.push_back(L"c" + std::to_wstring(c));
+		schema += L"," + columns.back() + L" text";
+	}
+	schema += L",image blob";
+	d->create_table(L"dao_table", schema);
+	d->create_table(L"raw_table", schema);
+	table_adapter adapter(d, L"dao_table");
+
+	string raw_insert = "insert into raw_table values(?";
+	for(size_t c = 0; c <= s.text_columns; ++c) raw_insert += ",?";
+	raw_insert += ")";
+	string text(16, 'x');
+	vector<char> blob(s.blob_bytes, 'b');
+	sqlite3* db = nullptr;
+	sqlite3_open(path.string().c_str(), &db);
+	sqlite3_exec(db, "pragma synchronous=off", 0, 0, nullptr);
+
+	auto make_values = [&](size_t i)
+	{
+		auto values = Values("id", (int64_t)i);
+		BOOST_FOREACH(auto& c, columns)
+			values(c, text);
+		if(blob.size()) values("image", blob);
+		return values;
+	};
+	auto raw_step = [](sqlite3_stmt* stmt)
+	{
+		sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+	};
+
+	cout << "rows " << s.rows << ", text columns " << s.text_columns << ", blob bytes " << s.blob_bytes << endl;
+	cout << left << setw(28) << "operation" << right << setw(14) << "ops/s" << setw(12) << "p50 us" << setw(12) << "p99 us" << setw(12) << "allocs/op" << endl;
+
+	report(measure("adapter +=", s.rows, [&](size_t i) {adapter += make_values(i);}));
+	{
+		raw_statement stmt(db, raw_insert.c_str());
+		report(measure("raw insert", s.rows, [&](size_t i)
+		{
+			sqlite3_bind_int64(stmt, 1, (int64_t)i);
+			for(size_t c = 0; c < s.text_columns; ++c)
+				sqlite3_bind_text(stmt, (int)c + 2, text.c_str(), (int)text.size(), SQLITE_STATIC);
+			sqlite3_bind_blob(stmt, (int)s.text_columns + 2, blob.data(), (int)blob.size(), SQLITE_STATIC);
+			raw_step(stmt);
+		}));
+	}
+
+	size_t scans = (std::max)((size_t)1, (size_t)(1000000 / (s.rows + 1)));
+	{
+		//decoding is timed as a scan that decodes every cell less a scan that only steps. every row is decoded into
+		//fresh null cells, as a table fill does, so no text or blob buffer is reused. both scans reset the row, so
+		//its cost is left out.
+		raw_statement stmt(db, "select * from raw_table");
+		int column_count = sqlite3_column_count(stmt);
+		vector<value_t> row;
+		uint64_t cells = 0, stepping = 0, decoding = 0;
+		for(size_t pass = 0; pass < scans; ++pass)
+		{
+			auto started = cycles();
+			while(SQLITE_ROW == sqlite3_step(stmt))
+				row.assign(column_count, value_t());
+			sqlite3_reset(stmt);
+			stepping += cycles() - started;
+			started = cycles();
+			while(SQLITE_ROW == sqlite3_step(stmt))
+			{
+				row.assign(column_count, value_t());
+				for(int c = 0; c < column_count; ++c)
+					column_value(stmt, c, row[c]);
+				cells += column_count;
+			}
+			sqlite3_reset(stmt);
+			decoding += cycles() - started;
+		}
+		report_cells("decode value_t", decoding > stepping ? decoding - stepping : 0, cells);
+
+		raw_statement insert(db, raw_insert.c_str());
+		auto values = make_values(0);
+		row.assign(1, (int64_t)0);
+		BOOST_FOREACH(auto& c, columns)
+			row.push_back(values[c]);
+		row.push_back(blob);
+		uint64_t binds = s.rows * 100;
+		auto started = cycles();
+		for(uint64_t i = 0; i < binds; ++i)
+			for(size_t c = 0; c < row.size(); ++c)
+				bind_value(insert, (int)c + 1, row[c], SQLITE_STATIC);
+		report_cells("bind value_t", cycles() - started, binds * row.size());
+		started = cycles();
+		for(uint64_t i = 0; i < binds; ++i)
+		{
+			sqlite3_bind_int64(insert, 1, (int64_t)i);
+			for(size_t c = 0; c < s.text_columns; ++c)
+				sqlite3_bind_text(insert, (int)c + 2, text.c_str(), (int)text.size(), SQLITE_STATIC);
+			sqlite3_bind_blob(insert, (int)s.text_columns + 2, blob.data(), (int)blob.size(), SQLITE_STATIC);
+		}
+		report_cells("raw bind", cycles() - started, binds * row.size());
+		sqlite3_clear_bindings(insert);
+	}
+	report(measure("adapter >> (full scan)", scans, [&](size_t) {table t; adapter >> t;}));
+	{
+		raw_statement stmt(db, "select * from raw_table");
+		report(measure("raw select (full scan)", scans, [&](size_t)
+		{
+			int64_t sum = 0;
+			while(SQLITE_ROW == sqlite3_step(stmt))
+			{
+				sum += sqlite3_column_int64(stmt, 0);
+				for(int c = 1; c < sqlite3_column_count(stmt); ++c)
+					sum += sqlite3_column_bytes(stmt, c);
+			}
+			sqlite3_reset(stmt);
+		}));
+	}
+
+	report(measure("adapter[] >> (point)", s.rows, [&](size_t i) {table t; adapter["id=" + std::to_string(i)] >> t;}));
+	report(measure("adapter[col] >> (point)", s.rows, [&](size_t i) {table t; adapter[col("id") == (int64_t)i] >> t;}));
+	{
+		auto point = adapter["id=:id"].compile();
+		table t;
+		report(measure("compiled (point)", s.rows, [&](size_t i) {point.fill(t, (int64_t)i);}));
+	}
+	{
+		raw_statement stmt(db, "select * from raw_table where id=?");
+		report(measure("raw select (point)", s.rows, [&](size_t i)
+		{
+			sqlite3_bind_int64(stmt, 1, (int64_t)i);
+			while(SQLITE_ROW == sqlite3_step(stmt))
+				sqlite3_column_text(stmt, 1);
+			sqlite3_reset(stmt);
+		}));
+	}
+
+	report(measure("adapter ^=", s.rows, [&](size_t i) {adapter["id=" + std::to_string(i)] ^= Values(columns[0], "updated");}));
+	{
+		raw_statement stmt(db, "update raw_table set c0=? where id=?");
+		report(measure("raw update", s.rows, [&](size_t i)
+		{
+			sqlite3_bind_text(stmt, 1, "updated", -1, SQLITE_STATIC);
+			sqlite3_bind_int64(stmt, 2, (int64_t)i);
+			raw_step(stmt);
+		}));
+	}
+
+	//every row exists, so |= is the update of all the given columns and never falls back to the insert.
+	report(measure("adapter |= (existing)", s.rows, [&](size_t i) {adapter["id=" + std::to_string(i)] |= make_values(i);}));
+	{
+		string raw_update_all = "update raw_table set id=?";
+		for(size_t c = 0; c < s.text_columns; ++c) raw_update_all += ",c" + std::to_string(c) + "=?";
+		raw_update_all += ",image=? where id=?";
+		raw_statement stmt(db, raw_update_all.c_str());
+		report(measure("raw update (all columns)", s.rows, [&](size_t i)
+		{
+			sqlite3_bind_int64(stmt, 1, (int64_t)i);
+			for(size_t c = 0; c < s.text_columns; ++c)
+				sqlite3_bind_text(stmt, (int)c + 2, text.c_str(), (int)text.size(), SQLITE_STATIC);
+			sqlite3_bind_blob(stmt, (int)s.text_columns + 2, blob.data(), (int)blob.size(), SQLITE_STATIC);
+			sqlite3_bind_int64(stmt, (int)s.text_columns + 3, (int64_t)i);
+			raw_step(stmt);
+		}));
+	}
+
+	report(measure("adapter.rows()", 1000, [&](size_t) {adapter.rows();}));
+	{
+		raw_statement stmt(db, "select count(*) from raw_table");
+		report(measure("raw count(*)", 1000, [&](size_t)
+		{
+			sqlite3_step(stmt);
+			sqlite3_column_int64(stmt, 0);
+			sqlite3_reset(stmt);
+		}));
+	}
+
+	report(measure("dao::execute (bound)", s.rows, [&](size_t i)
+	{
+		command cmd(L"select c0 from dao_table where id=:id");
+		cmd.bind_parameter(L"id", (int64_t)i);
+		table t;
+		d->execute(cmd, &t);
+	}));
+	{
+		raw_statement stmt(db, "select c0 from raw_table where id=?");
+		report(measure("raw execute (bound)", s.rows, [&](size_t i)
+		{
+			sqlite3_bind_int64(stmt, 1, (int64_t)i);
+			while(SQLITE_ROW == sqlite3_step(stmt))
+				sqlite3_column_text(stmt, 0);
+			sqlite3_reset(stmt);
+		}));
+	}
+
+	report(measure("adapter -=", s.rows, [&](size_t i) {adapter -= Values("id", (int64_t)i);}));
+	{
+		raw_statement stmt(db, "delete from raw_table where id=?");
+		report(measure("raw delete", s.rows, [&](size_t i)
+		{
+			sqlite3_bind_int64(stmt, 1, (int64_t)i);
+			raw_step(stmt);
+		}));
+	}
+
+	sqlite3_close(db);
+	d->close();
+	boost::filesystem::remove(path);
+	return 0;
+}
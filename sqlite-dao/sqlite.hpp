@@ -15,36 +15,97 @@
 #include <boost/assign.hpp>
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
 #include <custom/usefultypes.hpp>
 #include <custom/exceptions.hpp>
 #include <custom/codepage.hpp>
 #include <custom/compact_archive.hpp>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <regex>
+#include <list>
+#include <unordered_map>
+#include <tuple>
+#include <utility>
 #include <boost/integer.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <cwctype>
+#include <atomic>
+#include <cmath>
+#include <sstream>
+//the bundled sqlite3.h and sqlite3.lib are sqlite 3.3.6. defining SQLITE_HSD_SYSTEM_SQLITE takes sqlite3.h from the
+//include path instead, and leaves linking to the project, so the api that needs a newer sqlite is compiled in.
+#ifdef SQLITE_HSD_SYSTEM_SQLITE
+#include <sqlite3.h>
+#else
 #include "sqlite3.h"
+#ifdef _MSC_VER
 #pragma comment(lib, "sqlite3.lib")
+#endif
+#endif
 
 using namespace std;
 
 #define	Values	sqlite_hsd::mapped_values<sqlite_hsd::value_t>()
 #define	TRANSACTION_SCOPE(d)			auto trans = (d).transaction_scope()
+//declares the columns of a struct once, e.g. RECORD_MAPPING(person, field(L"id", &person::id), field(L"name", &person::name));
+//must be used at global scope.
+#define	RECORD_MAPPING(Type, ...)	\
+	template<> struct sqlite_hsd::record_mapping<Type>	\
+	{	\
+		enum {mapped = true};	\
+		static auto fields() -> decltype(std::make_tuple(__VA_ARGS__)) {return std::make_tuple(__VA_ARGS__);}	\
+	}
 namespace sqlite_hsd
 {
-	typedef boost::variant<nullptr_t, int64_t, double, wstring, vector<char>> __value_t;
+	//text values are held as wstring by default. defining SQLITE_HSD_UTF8 keeps them as utf-8 std::string instead,
+	//so they go to and come from sqlite without transcoding, and narrow string arguments are taken as utf-8 rather than acp.
+#ifdef SQLITE_HSD_UTF8
+	typedef string text_t;
+#define	SQLITE_HSD_CODEPAGE	CP_UTF8
+	inline wstring narrow_to_unicode(const string& s) {return codepage::utf8_to_unicode(s);}
+	inline string unicode_to_narrow(const wstring& s) {return codepage::unicode_to_utf8(s);}
+	inline const text_t& unicode_to_text(const string& s) {return s;}
+	inline text_t unicode_to_text(const wstring& s) {return codepage::unicode_to_utf8(s);}
+	inline wstring text_to_unicode(const text_t& s) {return codepage::utf8_to_unicode(s);}
+	inline const string& text_to_utf8(const text_t& s) {return s;}
+	inline text_t utf8_to_text(const char* s, size_t n) {return text_t(s, n);}
+#else
+	typedef wstring text_t;
+#define	SQLITE_HSD_CODEPAGE	CP_ACP
+	inline wstring narrow_to_unicode(const string& s) {return codepage::acp_to_unicode(s);}
+	inline string unicode_to_narrow(const wstring& s) {return codepage::unicode_to_acp(s);}
+	inline text_t unicode_to_text(const string& s) {return codepage::acp_to_unicode(s);}
+	inline const text_t& unicode_to_text(const wstring& s) {return s;}
+	inline const wstring& text_to_unicode(const text_t& s) {return s;}
+	inline string text_to_utf8(const text_t& s) {return codepage::unicode_to_utf8(s);}
+	inline text_t utf8_to_text(const char* s, size_t n) {return codepage::utf8_to_unicode(string(s, n));}
+#endif
+	typedef boost::variant<nullptr_t, int64_t, double, text_t, vector<char>> __value_t;
 	class value_t : __value_t
 	{
 		template<class Type>
 		struct is_compatible
 		{
-			enum {value = is_convertible<Type, int64_t>::value || is_convertible<Type, double>::value || is_convertible<Type, wstring>::value || is_convertible<Type, vector<char>>::value};
+			enum {value = is_convertible<Type, int64_t>::value || is_convertible<Type, double>::value || is_convertible<Type, text_t>::value || is_convertible<Type, vector<char>>::value};
 		};
 		struct value_from_string
 		{
 			__value_t operator()(const string& t)
 			{
-				return codepage::acp_to_unicode(t);
+				return unicode_to_text(t);
+			}
+		};
+		struct value_from_wstring
+		{
+			__value_t operator()(const wstring& t)
+			{
+				return unicode_to_text(t);
 			}
 		};
 		struct value_from_integer
@@ -91,11 +152,13 @@ namespace sqlite_hsd
 			__value_t operator()(const Type& t)
 			{
 				typedef
-					boost::mpl::if_c<is_same<Type, value_t>::value, value_from_value_t,
-					boost::mpl::if_c<is_same<Type, __value_t>::value, value_from_value,
-					boost::mpl::if_c<boost::is_integral<Type>::value, value_from_integer,
-					boost::mpl::if_c<is_convertible<Type, string>::value, value_from_string,
-					boost::mpl::if_c<is_compatible<Type>::value, value_from_directly<Type>, value_from_other_type<Type>
+					typename boost::mpl::if_c<is_same<Type, value_t>::value, value_from_value_t,
+					typename boost::mpl::if_c<is_same<Type, __value_t>::value, value_from_value,
+					typename boost::mpl::if_c<boost::is_integral<Type>::value, value_from_integer,
+					typename boost::mpl::if_c<is_convertible<Type, string>::value, value_from_string,
+					typename boost::mpl::if_c<is_convertible<Type, wstring>::value, value_from_wstring,
+					typename boost::mpl::if_c<is_compatible<Type>::value, value_from_directly<Type>, value_from_other_type<Type>
+					>::type
 					>::type
 					>::type
 					>::type
@@ -105,51 +168,54 @@ namespace sqlite_hsd
 			}
 		};
 
+		//the conversions are visitors, so they dispatch on the index of the held type instead of comparing type_info.
+		template<class Result>
+		struct value_visitor : boost::static_visitor<Result>
+		{
+			Result operator()(nullptr_t)const {throw exception2() << error_wtext(L"invalid conversion");}
+		};
 		struct value_to_string
 		{
 			string operator()(const value_t& v)
 			{
-				return codepage::unicode_to_acp(v.to<wstring>());
+#ifdef SQLITE_HSD_UTF8
+				if(text_value == v.which()) return get<text_t>(v);
+#endif
+				return unicode_to_narrow(v.to<wstring>());
 			}
 		};
-		struct value_to_integer
+		struct value_to_integer : value_visitor<int64_t>
 		{
-			int64_t operator()(const value_t& v)
-			{
-				if(v.type() == typeid(int64_t)) return get<int64_t>(v);
-				else if(v.type() == typeid(double)) return (int64_t)get<double>(v);
-				else if(v.type() == typeid(wstring)) return boost::lexical_cast<int64_t, wstring>(get<wstring>(v));
-				else if(v.type() == typeid(vector<char>)) return deserialize_chunk<int64_t>(get<vector<char>>(v));
-				else throw exception2() << error_wtext(L"invalid conversion");
-			}
+			using value_visitor<int64_t>::operator();
+			int64_t operator()(int64_t v)const {return v;}
+			int64_t operator()(double v)const {return (int64_t)v;}
+			int64_t operator()(const text_t& v)const {return boost::lexical_cast<int64_t, text_t>(v);}
+			int64_t operator()(const vector<char>& v)const {return deserialize_chunk<int64_t>(v);}
+			int64_t operator()(const value_t& v)const {return boost::apply_visitor(*this, (const __value_t&)v);}
 		};
-		struct value_to_double
+		struct value_to_double : value_visitor<double>
 		{
-			double operator()(const value_t& v)
-			{
-				if(v.type() == typeid(double)) return get<double>(v);
-				else if(v.type() == typeid(int64_t)) return (double)get<int64_t>(v);
-				else if(v.type() == typeid(wstring)) return boost::lexical_cast<double, wstring>(get<wstring>(v));
-				else if(v.type() == typeid(vector<char>)) return deserialize_chunk<double>(get<vector<char>>(v));
-				else throw exception2() << error_wtext(L"invalid conversion");
-			}
+			using value_visitor<double>::operator();
+			double operator()(int64_t v)const {return (double)v;}
+			double operator()(double v)const {return v;}
+			double operator()(const text_t& v)const {return boost::lexical_cast<double, text_t>(v);}
+			double operator()(const vector<char>& v)const {return deserialize_chunk<double>(v);}
+			double operator()(const value_t& v)const {return boost::apply_visitor(*this, (const __value_t&)v);}
 		};
-		struct value_to_wstring
+		struct value_to_wstring : value_visitor<wstring>
 		{
-			wstring operator()(const value_t& v)
-			{
-				if(typeid(wstring) == v.type()) return get<wstring>(v);
-				else if(typeid(int64_t) == v.type()) return boost::lexical_cast<wstring, int64_t>(get<int64_t>(v));
-				else if(typeid(double) == v.type()) return boost::lexical_cast<wstring, double>(get<double>(v));
-				else if(typeid(vector<char>) == v.type()) return deserialize_chunk<wstring>(get<vector<char>>(v));
-				else throw exception2() << error_wtext(L"invalid conversion");
-			}
+			using value_visitor<wstring>::operator();
+			wstring operator()(int64_t v)const {return boost::lexical_cast<wstring, int64_t>(v);}
+			wstring operator()(double v)const {return boost::lexical_cast<wstring, double>(v);}
+			wstring operator()(const text_t& v)const {return text_to_unicode(v);}
+			wstring operator()(const vector<char>& v)const {return deserialize_chunk<wstring>(v);}
+			wstring operator()(const value_t& v)const {return boost::apply_visitor(*this, (const __value_t&)v);}
 		};
 		struct value_to_vector
 		{
 			vector<char> operator()(const value_t& v)
 			{
-				if(typeid(vector<char>) == v.type()) return get<vector<char>>(v);
+				if(blob_value == v.which()) return get<vector<char>>(v);
 				else throw exception2() << error_wtext(L"invalid conversion");
 			}
 		};
@@ -169,11 +235,11 @@ namespace sqlite_hsd
 			Type operator()(const value_t& v)
 			{
 				typedef
-					boost::mpl::if_c<is_convertible<string, Type>::value, value_to_string,
-					boost::mpl::if_c<boost::is_integral<Type>::value, value_to_integer,
-					boost::mpl::if_c<boost::is_convertible<double, Type>::value, value_to_double,
-					boost::mpl::if_c<boost::is_convertible<wstring, Type>::value, value_to_wstring,
-					boost::mpl::if_c<boost::is_convertible<vector<char>, Type>::value, value_to_vector,
+					typename boost::mpl::if_c<is_convertible<string, Type>::value, value_to_string,
+					typename boost::mpl::if_c<boost::is_integral<Type>::value, value_to_integer,
+					typename boost::mpl::if_c<boost::is_convertible<double, Type>::value, value_to_double,
+					typename boost::mpl::if_c<boost::is_convertible<wstring, Type>::value, value_to_wstring,
+					typename boost::mpl::if_c<boost::is_convertible<vector<char>, Type>::value, value_to_vector,
 					value_to_other_type<Type>
 					>::type
 					>::type
@@ -184,11 +250,17 @@ namespace sqlite_hsd
 			}
 		};
 	public:
+		//the index of the held type, in the order of __value_t.
+		enum kind {null_value, integer_value, real_value, text_value, blob_value};
+
 		template<class Type> value_t(const Type& t) : __value_t(value_from<Type>()(t)) {}
 		value_t(const value_t& t) : __value_t((const __value_t&)t) {}
+		value_t(value_t&& t) noexcept : __value_t(std::move((__value_t&)t)) {}
+		value_t(text_t&& t) : __value_t(std::move(t)) {}
+		value_t(vector<char>&& t) : __value_t(std::move(t)) {}
 		template<class Type> const value_t& operator =(const Type& v)
 		{
-			this->swap(value_from<Type>()(v));
+			(__value_t&)*this = value_from<Type>()(v);
 			return *this;
 		}
 		const value_t& operator = (const value_t& v)
@@ -196,6 +268,48 @@ namespace sqlite_hsd
 			(__value_t&)*this = (const __value_t&)v;
 			return *this;
 		}
+		const value_t& operator = (value_t&& v) noexcept
+		{
+			(__value_t&)*this = std::move((__value_t&)v);
+			return *this;
+		}
+		//the decoders assign through these, straight into the variant.
+		const value_t& operator = (int64_t v)
+		{
+			(__value_t&)*this = v;
+			return *this;
+		}
+		const value_t& operator = (double v)
+		{
+			(__value_t&)*this = v;
+			return *this;
+		}
+		const value_t& operator = (text_t&& v)
+		{
+			(__value_t&)*this = std::move(v);
+			return *this;
+		}
+		const value_t& operator = (vector<char>&& v)
+		{
+			(__value_t&)*this = std::move(v);
+			return *this;
+		}
+		//a value that already holds text or a blob keeps its buffer.
+		void assign_text(const char* utf8, size_t size)
+		{
+#ifdef SQLITE_HSD_UTF8
+			if(text_value == which()) boost::get<text_t>((__value_t&)*this).assign(utf8, size);
+			else *this = text_t(utf8, size);
+#else
+			*this = utf8_to_text(utf8, size);
+#endif
+		}
+		void assign_blob(const void* data, size_t size)
+		{
+			auto begin = (const char*)data;
+			if(blob_value == which()) boost::get<vector<char>>((__value_t&)*this).assign(begin, begin + size);
+			else *this = vector<char>(begin, begin + size);
+		}
 
 		value_t() {}
 		template<class Type> operator Type ()const {return value_to<Type>()(*this);}
@@ -204,13 +318,16 @@ namespace sqlite_hsd
 		string to_string()const {return std::move(value_to<string>()(*this));}
 		bool to_bool()const {return to<int64_t>() ? true : false;}
 
+#ifdef _MSC_VER
 		__declspec(property(get = to_blob)) vector<char> blob;
 		__declspec(property(get = to_wstring)) wstring wtext;
 		__declspec(property(get = to_string)) string text;
 		__declspec(property(get = to_bool)) bool boolean;
+#endif
 
-		bool empty()const {return typeid(nullptr_t) == type();}
-		const std::type_info& type()const {return __super::type();}
+		bool empty()const {return null_value == which();}
+		kind which()const {return (kind)__value_t::which();}
+		const std::type_info& type()const {return __value_t::type();}
 		template<class Type> Type to()const {return value_to<Type>()(*this);}
 	};
 
@@ -224,87 +341,297 @@ namespace sqlite_hsd
 		}
 		mapped_values& operator()(const string& key, const ValueType& value)
 		{
-			return operator()(codepage::acp_to_unicode(key), value);
+			return operator()(narrow_to_unicode(key), value);
 		}
 	};
 	template<int N>
 	struct mapped_values<const wchar_t[N]> : public mapped_values<wstring> {};
 	typedef mapped_values<value_t> mapped_table;
 
+	struct arena_stats
+	{
+		uint64_t	allocations;
+		uint64_t	blocks;
+		uint64_t	bytes_reserved;
+		uint64_t	bytes_used;
+	};
+	//monotonic memory for one result. allocations are carved out of large blocks and only given back all at once by release.
+	//not thread safe.
+	class result_arena : boost::noncopyable
+	{
+	private:
+		vector<char*>		m_blocks;
+		size_t				m_block_size;
+		char*				m_cursor;
+		size_t				m_left;
+		arena_stats			m_stats;
+
+	public:
+		result_arena(size_t block_size = 256 * 1024) : m_block_size(block_size), m_cursor(nullptr), m_left(0)
+		{
+			m_stats = arena_stats();
+		}
+		~result_arena() {release();}
+
+		void* allocate(size_t bytes, size_t alignment)
+		{
+			size_t padding = (alignment - ((size_t)m_cursor & (alignment - 1))) & (alignment - 1);
+			if(nullptr == m_cursor || padding + bytes > m_left)
+			{
+				size_t size = (std::max)(m_block_size, bytes + alignment);
+				m_cursor = new char[size];
+				m_left = size;
+				m_blocks.push_back(m_cursor);
+				++m_stats.blocks;
+				m_stats.bytes_reserved += size;
+				padding = (alignment - ((size_t)m_cursor & (alignment - 1))) & (alignment - 1);
+			}
+			auto p = m_cursor + padding;
+			m_cursor = p + bytes;
+			m_left -= padding + bytes;
+			++m_stats.allocations;
+			m_stats.bytes_used += bytes;
+			return p;
+		}
+		//frees every block. nothing allocated from the arena may be used afterwards.
+		void release()
+		{
+			BOOST_FOREACH(auto block, m_blocks)
+				delete[] block;
+			m_blocks.clear();
+			m_cursor = nullptr;
+			m_left = 0;
+		}
+		arena_stats statistics()const {return m_stats;}
+		void reset_statistics() {m_stats = arena_stats();}
+	};
+	//allocates from a result_arena, or from the heap when constructed without one.
+	template<class Type>
+	class arena_allocator
+	{
+		template<class Other> friend class arena_allocator;
+	private:
+		result_arena*	m_arena;
+	public:
+		typedef Type value_type;
+		template<class Other> struct rebind {typedef arena_allocator<Other> other;};
+		//a moved or swapped container keeps the arena its storage came from
+		typedef std::true_type propagate_on_container_move_assignment;
+		typedef std::true_type propagate_on_container_swap;
+
+		arena_allocator(result_arena* arena = nullptr) : m_arena(arena) {}
+		template<class Other> arena_allocator(const arena_allocator<Other>& other) : m_arena(other.m_arena) {}
+
+		Type* allocate(size_t n)
+		{
+			if(m_arena) return (Type*)m_arena->allocate(n * sizeof(Type), alignof(Type));
+			return (Type*)::operator new(n * sizeof(Type));
+		}
+		void deallocate(Type* p, size_t)
+		{
+			if(nullptr == m_arena) ::operator delete(p);
+		}
+		template<class Other> bool operator ==(const arena_allocator<Other>& other)const {return m_arena == other.m_arena;}
+		template<class Other> bool operator !=(const arena_allocator<Other>& other)const {return m_arena != other.m_arena;}
+	};
+
+	//case-insensitive column name index. lookups hash and compare in place, without building a lowered copy.
+	struct column_name_hash
+	{
+		size_t operator()(const wstring& name)const
+		{
+			size_t h = 2166136261u;
+			BOOST_FOREACH(auto c, name)
+				h = (h ^ (size_t)towlower(c)) * 16777619u;
+			return h;
+		}
+	};
+	struct column_name_equal
+	{
+		bool operator()(const wstring& a, const wstring& b)const
+		{
+			if(a.size() != b.size()) return false;
+			for(size_t i = 0; i < a.size(); ++i)
+				if(a[i] != b[i] && towlower(a[i]) != towlower(b[i])) return false;
+			return true;
+		}
+	};
+	typedef unordered_map<wstring, int, column_name_hash, column_name_equal> column_name_index;
+	//a column position resolved once per result, e.g. auto c = t.column("name"); then t[i][c].
+	struct column_handle
+	{
+		int		index;
+
+		column_handle(int i = -1) : index(i) {}
+		bool valid()const {return index >= 0;}
+	};
+
 	class table
 	{
 		friend class dao;
+		friend class compiled_query;
+		friend class table_adapter;
 	public:
 		class record
 		{
 			friend class table;
 		private:
-			vector<value_t>			m_values;
-			const table*			m_owner;
+			vector<value_t, arena_allocator<value_t>>	m_values;
+			const table*								m_owner;
 
 		public:
-			record(const table* owner) : m_owner(owner)
+			record(const table* owner) : m_values(arena_allocator<value_t>(owner->m_arena.get())), m_owner(owner)
 			{
 				m_values.assign(m_owner->column_number(), value_t());
 			}
 		public:
 			value_t& operator[](int column) {return m_values[column];}
 			const value_t& operator[](int column)const {return m_values[column];}
-			const value_t& operator[](const wstring& column)const
+			const value_t& operator[](column_handle column)const
 			{
 				static const value_t s_empty_value;
-				wstring name = boost::to_lower_copy(column);
-				auto itr = m_owner->m_column_names.find(name);
-				if(m_owner->m_column_names.end() == itr) return s_empty_value;
-				return operator[](itr->second);
+				if(false == column.valid() || column.index >= (int)m_values.size()) return s_empty_value;
+				return m_values[column.index];
 			}
-			const value_t& operator [](const string& column)const {return operator[](codepage::acp_to_unicode(column));}
+			const value_t& operator[](const wstring& column)const {return operator[](m_owner->column(column));}
+			const value_t& operator [](const string& column)const {return operator[](narrow_to_unicode(column));}
 		};
 
 	private:
-		map<wstring, int>			m_column_names;
-		vector<record>				m_records;
+		std::shared_ptr<result_arena>				m_arena;
+		column_name_index								m_column_names;
+		vector<wstring>								m_column_list;
+		vector<record, arena_allocator<record>>		m_records;
 
 	protected:
 		void _add_column(const wstring& name)
 		{
 			auto name_l = boost::to_lower_copy(name);
-			if(m_column_names.end() != m_column_names.find(name_l)) return;
-			auto column = m_column_names.size();
-			m_column_names[name_l] = (int)column;
+			if(m_column_names.end() == m_column_names.find(name_l))
+				m_column_names[name_l] = (int)m_column_list.size();
+			m_column_list.push_back(name_l);
 		}
 		void _add_record()
 		{
 			m_records.push_back(record(this));
 		}
+		void _remove_last_column()
+		{
+			auto itr = m_column_names.find(m_column_list.back());
+			if(m_column_names.end() != itr && itr->second == (int)m_column_list.size() - 1)
+				m_column_names.erase(itr);
+			m_column_list.pop_back();
+			BOOST_FOREACH(auto& it, m_records)
+				it.m_values.pop_back();
+		}
+		void _copy_records(const table& other)
+		{
+			m_records.reserve(other.m_records.size());
+			BOOST_FOREACH(auto& it, other.m_records)
+			{
+				_add_record();
+				m_records.back().m_values.assign(it.m_values.begin(), it.m_values.end());
+			}
+		}
+		//takes the rows of other with their arena. other is left empty, on the heap.
+		void _adopt_records(table& other)
+		{
+			BOOST_FOREACH(auto& it, m_records)
+				it.m_owner = this;
+			other.m_records = vector<record, arena_allocator<record>>();
+			other.m_column_names.clear();
+			other.m_column_list.clear();
+		}
 
 	public:
+		table() {}
+		//rows and their value arrays are allocated from arena, which clear() gives back in one shot.
+		//the arena belongs to this table and must not be shared with another one.
+		explicit table(std::shared_ptr<result_arena> arena) : m_arena(arena), m_records(arena_allocator<record>(arena.get())) {}
+		//a copy never shares the arena: copied rows go to the heap, or to the arena of the table assigned to.
+		table(const table& other) : m_column_names(other.m_column_names), m_column_list(other.m_column_list)
+		{
+			_copy_records(other);
+		}
+		table(table&& other) : m_arena(std::move(other.m_arena)), m_column_names(std::move(other.m_column_names)),
+			m_column_list(std::move(other.m_column_list)), m_records(std::move(other.m_records))
+		{
+			_adopt_records(other);
+		}
+		table& operator =(const table& other)
+		{
+			if(this == &other) return *this;
+			clear();
+			m_column_names = other.m_column_names;
+			m_column_list = other.m_column_list;
+			_copy_records(other);
+			return *this;
+		}
+		table& operator =(table&& other)
+		{
+			if(this == &other) return *this;
+			clear();
+			m_records = std::move(other.m_records);
+			m_arena = std::move(other.m_arena);
+			m_column_names = std::move(other.m_column_names);
+			m_column_list = std::move(other.m_column_list);
+			_adopt_records(other);
+			return *this;
+		}
+
 		void clear(bool clear_column_names = true)
 		{
 			m_records.clear();
-			if(clear_column_names) m_column_names.clear();
+			if(m_arena)
+			{
+				m_records.shrink_to_fit();
+				m_arena->release();
+			}
+			if(clear_column_names)
+			{
+				m_column_names.clear();
+				m_column_list.clear();
+			}
 		}
+		std::shared_ptr<result_arena> arena()const {return m_arena;}
 		record& operator [](int row) {return m_records[row];}
 		const record& operator [](int row)const {return m_records[row];}
 
 	public:
-		long column_number()const {return (long)m_column_names.size();}
+		long column_number()const {return (long)m_column_list.size();}
 		long row_number()const {return (long)m_records.size();}
 		wstring column_name(size_t column)const
 		{
-			if(m_column_names.size() <= column) return L"";
-			for(auto itr = m_column_names.begin(); m_column_names.end() != itr; ++itr)
-				if(itr->second == column) return itr->first;
-			return L"";
+			if(m_column_list.size() <= column) return L"";
+			return m_column_list[column];
+		}
+		column_handle column(const wstring& name)const
+		{
+			auto itr = m_column_names.find(name);
+			return m_column_names.end() == itr ? column_handle() : column_handle(itr->second);
 		}
+		column_handle column(const string& name)const {return column(narrow_to_unicode(name));}
 	};
 
 	class command
 	{
+	public:
+		//a caller-owned text or blob buffer, bound without copying.
+		struct borrowed_buffer
+		{
+			int			index;
+			const void*	data;
+			int			size;
+			bool		text;
+		};
+
 	private:
 		wstring									m_command_text;
 		typedef custom::value_map_t<value_t>	CommandKeyValuePair;
 		CommandKeyValuePair						m_variants;
+		vector<value_t>							m_indexed;
+		vector<value_t>							m_unnamed;
+		vector<borrowed_buffer>					m_borrowed;
 
 	public:
 		command() : m_command_text(L"") {}
@@ -313,247 +640,3227 @@ namespace sqlite_hsd
 		const wstring& get_cmd_text()const {return m_command_text;}
 		const value_t& get_bind_value(const wstring& key)const {return m_variants.find(key)->second;}
 		void bind_parameter(const wstring& key, const value_t& variant) {m_variants[key] = variant;}
+		//binds the 1-based parameter index directly, for ? parameters or to skip the name lookup.
+		void bind_parameter(int index, const value_t& variant)
+		{
+			if((int)m_indexed.size() < index) m_indexed.resize(index);
+			m_indexed[index - 1] = variant;
+		}
+		//binds the next nameless ? parameter, counting them in the order they appear in the text.
+		void bind_unnamed(const value_t& variant) {m_unnamed.push_back(variant);}
+		//data is not copied and must stay alive until the statement has been executed, or the cursor over it closed.
+		void bind_blob(int index, const void* data, size_t size)
+		{
+			borrowed_buffer buffer = {index, data, (int)size, false};
+			m_borrowed.push_back(buffer);
+		}
+		void bind_text(int index, const char* utf8, size_t size)
+		{
+			borrowed_buffer buffer = {index, utf8, (int)size, true};
+			m_borrowed.push_back(buffer);
+		}
+		bool has_named_parameters()const {return false == m_variants.empty();}
+		const custom::value_map_t<value_t>& named_parameters()const {return m_variants;}
+		const vector<value_t>& indexed_parameters()const {return m_indexed;}
+		const vector<value_t>& unnamed_parameters()const {return m_unnamed;}
+		const vector<borrowed_buffer>& borrowed_parameters()const {return m_borrowed;}
 	};
-	class dao : boost::noncopyable, public std::enable_shared_from_this<dao>
+	//with SQLITE_STATIC the text and blob buffers of value are handed to sqlite as they are, so value must outlive the
+	//binding. the statement cache clears the bindings when a statement is given back.
+	struct value_binder : boost::static_visitor<>
 	{
-		friend class transaction;
-	protected:
-		class transaction : noncopyable
+		sqlite3_stmt*	stmt;
+		int				index;
+		void			(*destructor)(void*);
+
+		value_binder(sqlite3_stmt* s, int i, void(*d)(void*)) : stmt(s), index(i), destructor(d) {}
+		void operator()(nullptr_t)const {sqlite3_bind_null(stmt, index);}
+		void operator()(int64_t v)const {sqlite3_bind_int64(stmt, index, v);}
+		void operator()(double v)const {sqlite3_bind_double(stmt, index, v);}
+		void operator()(const text_t& text)const
 		{
-		private:
-			boost::recursive_mutex::scoped_lock	ul;
-			dao&						db;
-		public:
-			transaction(dao* d) : ul(d->m_connection_mutex), db(*d)
+#ifdef SQLITE_HSD_UTF8
+			sqlite3_bind_text(stmt, index, text.c_str(), (int)text.size(), destructor);
+#else
+			if(2 == sizeof(wchar_t))
+				sqlite3_bind_text16(stmt, index, text.c_str(), (int)(text.size() * sizeof(wchar_t)), destructor);
+			else
 			{
-				db.begin_transaction();
+				auto utf8 = text_to_utf8(text);
+				sqlite3_bind_text(stmt, index, utf8.c_str(), (int)utf8.size(), SQLITE_TRANSIENT);
 			}
-			~transaction()
+#endif
+		}
+		void operator()(const vector<char>& blob)const
+		{
+			if(blob.size() != 0)
+				sqlite3_bind_blob(stmt, index, &blob[0], (int)blob.size(), destructor);
+			else
+				sqlite3_bind_null(stmt, index);
+		}
+	};
+	//with SQLITE_STATIC the text and blob buffers of value are handed to sqlite as they are, so value must outlive the
+	//binding. the statement cache clears the bindings when a statement is given back.
+	inline void bind_value(sqlite3_stmt* stmt, int index, const value_t& value, void(*destructor)(void*) = SQLITE_TRANSIENT)
+	{
+		boost::apply_visitor(value_binder(stmt, index, destructor), (const __value_t&)value);
+	}
+	inline void bind_command(sqlite3_stmt* stmt, const command& cmd, void(*destructor)(void*) = SQLITE_TRANSIENT)
+	{
+		int		index;
+		int		parameter_count = sqlite3_bind_parameter_count(stmt);
+
+		if(cmd.has_named_parameters())
+		{
+			for(index = 1; index <= parameter_count; ++index)
 			{
-				try
-				{
-					db.commit_transaction();
-				}
-				catch(...)
-				{
-					db.rollback_transaction();
-				}
+				auto name = sqlite3_bind_parameter_name(stmt, index);
+				if(nullptr == name) continue;
+				bind_value(stmt, index, cmd.get_bind_value(codepage::utf8_to_unicode(name + 1)), destructor);
 			}
-		};
-	public:
-		dao() {}
-		virtual ~dao() {close();}
-
-		void open(const boost::filesystem::path& datasource, const wstring& password = L"")
+		}
+		auto& indexed = cmd.indexed_parameters();
+		for(index = 1; index <= (int)indexed.size() && index <= parameter_count; ++index)
+			bind_value(stmt, index, indexed[index - 1], destructor);
+		auto& unnamed = cmd.unnamed_parameters();
+		size_t next = 0;
+		for(index = 1; index <= parameter_count && next < unnamed.size(); ++index)
+			if(nullptr == sqlite3_bind_parameter_name(stmt, index))
+				bind_value(stmt, index, unnamed[next++], destructor);
+		BOOST_FOREACH(auto& buffer, cmd.borrowed_parameters())
 		{
-			DeclareSection(m_connection_mutex);
-			auto open_connection = [](const boost::filesystem::path& source)->std::shared_ptr<sqlite3>
-				{
-					sqlite3* connection = nullptr;
-					sqlite3_open(codepage::unicode_to_utf8(source.wstring()).c_str(), &connection);
-					return std::shared_ptr<sqlite3>(connection, sqlite3_close);
-				};
-			m_connection = open_connection(datasource);
-
-			if(false == password.empty()) 
+			if(buffer.text) sqlite3_bind_text(stmt, buffer.index, (const char*)buffer.data, buffer.size, SQLITE_STATIC);
+			else if(buffer.size) sqlite3_bind_blob(stmt, buffer.index, buffer.data, buffer.size, SQLITE_STATIC);
+			else sqlite3_bind_null(stmt, buffer.index);
+		}
+	}
+	//decodes the column into value in place.
+	inline void column_value(sqlite3_stmt* stmt, int column, value_t& value)
+	{
+		switch(sqlite3_column_type(stmt, column))
+		{
+		case SQLITE_INTEGER:
+			value = (int64_t)sqlite3_column_int64(stmt, column);
+			break;
+		case SQLITE_FLOAT:
+			value = sqlite3_column_double(stmt, column);
+			break;
+		case SQLITE_TEXT:
 			{
-				auto utf8_pwd = codepage::unicode_to_utf8(password);
-				sqlite3_key(m_connection.get(), utf8_pwd.c_str(), (int)utf8_pwd.size());
+				auto text = (const char*)sqlite3_column_text(stmt, column);
+				value.assign_text(text, sqlite3_column_bytes(stmt, column));
 			}
-			m_datasource = datasource;
+			break;
+		case SQLITE_BLOB:
+			{
+				auto data = sqlite3_column_blob(stmt, column);
+				value.assign_blob(data, sqlite3_column_bytes(stmt, column));
+			}
+			break;
+		default:
+			value = value_t();
 		}
-		void close()
+	}
+	inline value_t column_value(sqlite3_stmt* stmt, int column)
+	{
+		value_t value;
+		column_value(stmt, column, value);
+		return value;
+	}
+#if defined(SQLITE_ENABLE_PREUPDATE_HOOK) && SQLITE_VERSION_NUMBER >= 3013000
+	inline value_t sqlite_value(sqlite3_value* v)
+	{
+		switch(sqlite3_value_type(v))
 		{
-			DeclareSection(m_connection_mutex);
-			m_connection = std::shared_ptr<sqlite3>();
+		case SQLITE_INTEGER:
+			return sqlite3_value_int64(v);
+		case SQLITE_FLOAT:
+			return sqlite3_value_double(v);
+		case SQLITE_TEXT:
+			return utf8_to_text((const char*)sqlite3_value_text(v), sqlite3_value_bytes(v));
+		case SQLITE_BLOB:
+			{
+				auto data = (const char*)sqlite3_value_blob(v);
+				return vector<char>(data, data + sqlite3_value_bytes(v));
+			}
 		}
-		bool is_open()const {return m_connection != nullptr;}
-		boost::filesystem::path source()const {return m_datasource;}
-		size_t execute(const command& cmd, table* table = nullptr, uint64_t start = 0, uint64_t count = -1)
+		return value_t();
+	}
+#endif
+	struct statement_cache_statistics
+	{
+		uint64_t	hits;
+		uint64_t	misses;
+		uint64_t	evictions;
+		size_t		size;
+		size_t		capacity;
+	};
+	class statement_cache : boost::noncopyable
+	{
+	public:
+		typedef std::shared_ptr<sqlite3_stmt> statement_ptr;
+		class lease : boost::noncopyable
 		{
-			std::shared_ptr<sqlite3_stmt>	stmt;
-			int				index;
-			int				column_count;
-
-			DeclareSection(m_connection_mutex);
-
-			if(false == is_open()) _commit_error("data base is not open");
-			try{
-				auto text = codepage::unicode_to_utf8(cmd.get_cmd_text());
-				if(0 != start || -1 != count)
-				{
-					text += (boost::format(" limit %1%, %2%") % start % count).str();
-				}
-
-				stmt = [&text](std::shared_ptr<sqlite3> connection)->std::shared_ptr<sqlite3_stmt>
-					{
-						sqlite3_stmt* stmt;
-						sqlite3_prepare(connection.get(), text.c_str(), -1, &stmt, nullptr);
-						return std::shared_ptr<sqlite3_stmt>(stmt, sqlite3_finalize);
-					}(m_connection);
-				if(!stmt)
-					_commit_error();
-				column_count = sqlite3_bind_parameter_count(stmt.get());
-
-				for(index = 1; index <= column_count; ++index)
+		private:
+			statement_cache&	m_cache;
+			string				m_text;
+			statement_ptr		m_stmt;
+			bool				m_stepped;
+		public:
+			lease(statement_cache& cache, const string& text, statement_ptr stmt) : m_cache(cache), m_text(text), m_stmt(stmt), m_stepped(false) {}
+			~lease() {if(m_stmt) m_cache.release(m_text, m_stmt);}
+			sqlite3_stmt* get()const {return m_stmt.get();}
+			operator bool()const {return m_stmt != nullptr;}
+			//steps the statement. if the first step fails because another connection changed the schema,
+			//the statement is prepared again with its bindings carried over and stepped once more.
+			int step()
+			{
+				int ret = sqlite3_step(m_stmt.get());
+				if(m_stepped || SQLITE_ROW == ret || SQLITE_DONE == ret)
 				{
-					string text = sqlite3_bind_parameter_name(stmt.get(), index);
-					text.erase(0, 1);
-					auto value = cmd.get_bind_value(codepage::utf8_to_unicode(text));
-
-					if(typeid(wstring) == value.type()) sqlite3_bind_text(stmt.get(), index, codepage::unicode_to_utf8(value).c_str(), -1, SQLITE_TRANSIENT);
-					else if(typeid(int64_t) == value.type()) sqlite3_bind_int64(stmt.get(), index, value);
-					else if(typeid(double) == value.type()) sqlite3_bind_double(stmt.get(), index, value);
-					else if(typeid(vector<char>) == value.type())
-					{
-						auto vec = std::move(value.to_blob());
-						if(vec.size() != 0)
-							sqlite3_bind_blob(stmt.get(), index, &vec[0], (int)vec.size(), SQLITE_TRANSIENT);
-						else
-							sqlite3_bind_null(stmt.get(), index);
-					}
-					else if(value.empty()) sqlite3_bind_null(stmt.get(), index);
+					m_stepped = true;
+					return ret;
 				}
+				m_stepped = true;
+				if(SQLITE_SCHEMA != ret && SQLITE_SCHEMA != sqlite3_reset(m_stmt.get()))
+					return ret;
+				sqlite3_stmt* stmt = nullptr;
+				sqlite3_prepare(sqlite3_db_handle(m_stmt.get()), m_text.c_str(), -1, &stmt, nullptr);
+				if(nullptr == stmt) return ret;
+				statement_ptr fresh(stmt, sqlite3_finalize);
+				sqlite3_transfer_bindings(m_stmt.get(), stmt);
+				m_stmt = fresh;
+				return sqlite3_step(m_stmt.get());
+			}
+		};
 
-				int				column_count;
-				long			i, j;
-				int				ret;
-
-				column_count = sqlite3_column_count(stmt.get());
+	private:
+		typedef list<pair<string, statement_ptr>>				entry_list;
+		entry_list												m_entries;
+		unordered_map<string, entry_list::iterator>				m_index;
+		size_t													m_capacity;
+		uint64_t												m_hits;
+		uint64_t												m_misses;
+		uint64_t												m_evictions;
 
-				if(nullptr != table)
-				{
-					table->clear();
-					for(i = 0; i < column_count; ++i)
-						table->_add_column(codepage::utf8_to_unicode(sqlite3_column_name(stmt.get(), i)));
-				}
-				i = 0;
-				while(SQLITE_ROW == (ret = sqlite3_step(stmt.get())))
-				{
-					if(nullptr != table)
-					{
-						table->_add_record();
-						for(j = 0; j < column_count; ++j)
-						{
-							switch(sqlite3_column_type(stmt.get(), j))
-							{
-							case SQLITE_INTEGER:
-								(*table)[i][j] = sqlite3_column_int64(stmt.get(), j);
-								break;
-							case SQLITE_FLOAT:
-								(*table)[i][j] = sqlite3_column_double(stmt.get(), j);
-								break;
-							case SQLITE_TEXT:
-								(*table)[i][j] = codepage::utf8_to_unicode((const char*)sqlite3_column_text(stmt.get(), j));
-								break;
-							case SQLITE_BLOB:
-								{
-									vector<char> blob(sqlite3_column_bytes(stmt.get(), j));
-									memcpy(&blob[0], sqlite3_column_blob(stmt.get(), j), blob.size());
-									(*table)[i][j] = std::move(blob);
-								}
-								break;
-							case SQLITE_NULL:
-								(*table)[i][j] = value_t();
-								break;
-							}
-						}
-					}
-					++i;
-				}
+	public:
+		statement_cache(size_t capacity = 64) : m_capacity(capacity), m_hits(0), m_misses(0), m_evictions(0) {}
 
-				if(column_count && SQLITE_DONE != ret)
+		//checks a statement out of the cache, preparing it on a miss. the statement is owned by the caller until release.
+		statement_ptr acquire(sqlite3* connection, const string& text)
+		{
+			auto itr = m_index.find(text);
+			if(m_index.end() != itr)
+			{
+				auto stmt = itr->second->second;
+				m_entries.erase(itr->second);
+				m_index.erase(itr);
+				if(false == sqlite3_expired(stmt.get()))
 				{
-					_commit_error();
+					++m_hits;
+					return stmt;
 				}
-				return sqlite3_changes(m_connection.get());
-			}
-			catch(const exception2& e)
-			{
-				throw e;
 			}
-			catch(...)
+			++m_misses;
+			sqlite3_stmt* stmt = nullptr;
+#if SQLITE_VERSION_NUMBER >= 3003009
+			sqlite3_prepare_v2(connection, text.c_str(), -1, &stmt, nullptr);
+#else
+			sqlite3_prepare(connection, text.c_str(), -1, &stmt, nullptr);
+#endif
+			if(nullptr == stmt) return statement_ptr();
+			return statement_ptr(stmt, sqlite3_finalize);
+		}
+		//resets the statement and puts it back as the most recently used entry.
+		void release(const string& text, statement_ptr stmt)
+		{
+			sqlite3_reset(stmt.get());
+			sqlite3_clear_bindings(stmt.get());
+			if(0 == m_capacity || m_index.end() != m_index.find(text)) return;
+			m_entries.push_front(make_pair(text, stmt));
+			m_index[text] = m_entries.begin();
+			while(m_entries.size() > m_capacity)
 			{
-				commit_error(L"unknown error while executing command in sqlite_hsd.");
+				m_index.erase(m_entries.back().first);
+				m_entries.pop_back();
+				++m_evictions;
 			}
 		}
-		std::auto_ptr<transaction> transaction_scope()
+		void clear()
 		{
-			return std::auto_ptr<transaction>(new transaction(this));
+			m_index.clear();
+			m_entries.clear();
 		}
-		void get_table_info(const wstring& table_name, table* t)
+		void set_capacity(size_t capacity)
 		{
-			table dt;
-			wchar_t text_buffer[1024];
-
-			wsprintf(text_buffer, TEXT("select sql from sqlite_master where name = '%s'"), table_name);
-			const_cast<dao*>(this)->execute(wstring(text_buffer), &dt, 0, -1);
-
-			t->clear();
-			t->_add_column(L"name");
-			t->_add_column(L"type");
-			t->_add_column(L"length");
-			t->_add_column(L"precision");
-			t->_add_column(L"restriction");
-			if(dt.row_number())
+			m_capacity = capacity;
+			while(m_entries.size() > m_capacity)
 			{
-				auto text = dt[0][0].wtext;
-				std::wregex reg(L"\\[\\w+\\].*");
-				wsregex_iterator itr(text.begin(), text.end(), reg);
-				wsregex_iterator end;
-				std::for_each(itr, end, [](const wsmatch& it)
-				{
-					//it[0] = line text
-					//set table trait record
-					assert(false);
-				});
+				m_index.erase(m_entries.back().first);
+				m_entries.pop_back();
+				++m_evictions;
 			}
 		}
-		void begin_transaction()
+		statement_cache_statistics statistics()const
 		{
-			m_connection_mutex.lock();
-			_exec("begin transaction;");
+			statement_cache_statistics stats = {m_hits, m_misses, m_evictions, m_entries.size(), m_capacity};
+			return stats;
 		}
-		void commit_transaction()
-		{
+		void reset_statistics() {m_hits = m_misses = m_evictions = 0;}
+	};
+	//bind borrows string and blob members, so the record must outlive the step that uses them.
+	template<class Type, class Enable = void>
+	struct column_traits
+	{
+		static_assert(sizeof(Type) == 0, "unsupported column type");
+	};
+	template<class Type>
+	struct column_traits<Type, typename enable_if<is_integral<Type>::value>::type>
+	{
+		static void read(sqlite3_stmt* stmt, int column, Type& v) {v = (Type)sqlite3_column_int64(stmt, column);}
+		static void bind(sqlite3_stmt* stmt, int index, const Type& v) {sqlite3_bind_int64(stmt, index, (int64_t)v);}
+	};
+	template<class Type>
+	struct column_traits<Type, typename enable_if<is_floating_point<Type>::value>::type>
+	{
+		static void read(sqlite3_stmt* stmt, int column, Type& v) {v = (Type)sqlite3_column_double(stmt, column);}
+		static void bind(sqlite3_stmt* stmt, int index, const Type& v) {sqlite3_bind_double(stmt, index, (double)v);}
+	};
+	//narrow strings are mapped as utf-8 with no transcoding.
+	template<>
+	struct column_traits<string>
+	{
+		static void read(sqlite3_stmt* stmt, int column, string& v)
+		{
+			auto text = (const char*)sqlite3_column_text(stmt, column);
+			if(text) v.assign(text, sqlite3_column_bytes(stmt, column));
+			else v.clear();
+		}
+		static void bind(sqlite3_stmt* stmt, int index, const string& v) {sqlite3_bind_text(stmt, index, v.c_str(), (int)v.size(), SQLITE_STATIC);}
+	};
+	template<>
+	struct column_traits<wstring>
+	{
+		static void read(sqlite3_stmt* stmt, int column, wstring& v)
+		{
+			auto text = (const char*)sqlite3_column_text(stmt, column);
+			v = text ? codepage::utf8_to_unicode(text) : wstring();
+		}
+		static void bind(sqlite3_stmt* stmt, int index, const wstring& v)
+		{
+			auto text = codepage::unicode_to_utf8(v);
+			sqlite3_bind_text(stmt, index, text.c_str(), (int)text.size(), SQLITE_TRANSIENT);
+		}
+	};
+	template<>
+	struct column_traits<vector<char>>
+	{
+		static void read(sqlite3_stmt* stmt, int column, vector<char>& v)
+		{
+			auto data = (const char*)sqlite3_column_blob(stmt, column);
+			v.assign(data, data + (data ? sqlite3_column_bytes(stmt, column) : 0));
+		}
+		static void bind(sqlite3_stmt* stmt, int index, const vector<char>& v)
+		{
+			if(v.size()) sqlite3_bind_blob(stmt, index, &v[0], (int)v.size(), SQLITE_STATIC);
+			else sqlite3_bind_null(stmt, index);
+		}
+	};
+
+	template<class Record, class Member>
+	struct record_field
+	{
+		const wchar_t*		name;
+		Member Record::*	member;
+	};
+	template<class Record, class Member>
+	record_field<Record, Member> field(const wchar_t* name, Member Record::* member)
+	{
+		record_field<Record, Member> f = {name, member};
+		return f;
+	}
+	//specialized by RECORD_MAPPING.
+	template<class Record>
+	struct record_mapping
+	{
+		enum {mapped = false};
+	};
+	template<class Record>
+	struct record_mapper
+	{
+	private:
+		template<class Func, size_t... I>
+		static void _for_each(Func f, std::index_sequence<I...>)
+		{
+			auto fields = record_mapping<Record>::fields();
+			int expand[] = {0, (f(std::get<I>(fields), (int)I), 0)...};
+			(void)expand;
+		}
+		template<class Func>
+		static void for_each(Func f)
+		{
+			_for_each(f, std::make_index_sequence<std::tuple_size<decltype(record_mapping<Record>::fields())>::value>());
+		}
+
+	public:
+		static_assert(record_mapping<Record>::mapped, "the record type has no RECORD_MAPPING");
+		enum {column_count = std::tuple_size<decltype(record_mapping<Record>::fields())>::value};
+
+		static wstring column_list()
+		{
+			wstring columns;
+			for_each([&columns](const auto& f, int)
+			{
+				if(columns.size()) columns += L",";
+				columns += f.name;
+			});
+			return columns;
+		}
+		static wstring parameter_list()
+		{
+			wstring parameters;
+			for(int i = 0; i < column_count; ++i)
+				parameters += i ? L",?" : L"?";
+			return parameters;
+		}
+		//columns are read positionally, in declaration order.
+		static void read(sqlite3_stmt* stmt, Record& r)
+		{
+			for_each([stmt, &r](const auto& f, int column)
+			{
+				typedef typename std::decay<decltype(r.*(f.member))>::type member_type;
+				column_traits<member_type>::read(stmt, column, r.*(f.member));
+			});
+		}
+		static void bind(sqlite3_stmt* stmt, const Record& r, int first_index = 1)
+		{
+			for_each([stmt, &r, first_index](const auto& f, int column)
+			{
+				typedef typename std::decay<decltype(r.*(f.member))>::type member_type;
+				column_traits<member_type>::bind(stmt, first_index + column, r.*(f.member));
+			});
+		}
+	};
+	template<class Record>
+	struct is_mapped_record
+	{
+		enum {value = record_mapping<Record>::mapped};
+	};
+
+	//non-owning view of a blob cell. points into sqlite's column buffer and is valid until the next step.
+	struct blob_ref
+	{
+		const char*	data;
+		size_t		size;
+
+		blob_ref() : data(nullptr), size(0) {}
+		blob_ref(const char* d, size_t n) : data(d), size(n) {}
+		const char* begin()const {return data;}
+		const char* end()const {return data + size;}
+		bool empty()const {return 0 == size;}
+		vector<char> to_vector()const {return vector<char>(begin(), end());}
+	};
+	class cursor : boost::noncopyable
+	{
+	public:
+		class row
+		{
+			friend class cursor;
+		private:
+			sqlite3_stmt*							m_stmt;
+			const cursor*							m_owner;
+
+			row(const cursor* owner) : m_stmt(nullptr), m_owner(owner) {}
+		public:
+			value_t operator[](int column)const {return column_value(m_stmt, column);}
+			value_t operator[](const wstring& column)const
+			{
+				int index = m_owner->column_index(column);
+				if(index < 0) return value_t();
+				return column_value(m_stmt, index);
+			}
+			value_t operator[](const string& column)const {return operator[](narrow_to_unicode(column));}
+			long column_number()const {return m_owner->column_number();}
+
+			//zero-copy accessors. the returned views point into sqlite's buffers and are valid until the next step.
+			int type(int column)const {return sqlite3_column_type(m_stmt, column);}
+			bool is_null(int column)const {return SQLITE_NULL == type(column);}
+			int64_t integer(int column)const {return sqlite3_column_int64(m_stmt, column);}
+			double real(int column)const {return sqlite3_column_double(m_stmt, column);}
+			boost::string_ref utf8(int column)const
+			{
+				auto text = (const char*)sqlite3_column_text(m_stmt, column);
+				if(nullptr == text) return boost::string_ref();
+				return boost::string_ref(text, sqlite3_column_bytes(m_stmt, column));
+			}
+			blob_ref blob(int column)const
+			{
+				auto data = (const char*)sqlite3_column_blob(m_stmt, column);
+				if(nullptr == data) return blob_ref();
+				return blob_ref(data, sqlite3_column_bytes(m_stmt, column));
+			}
+			int64_t integer(const wstring& column)const {return integer(m_owner->checked_column_index(column));}
+			double real(const wstring& column)const {return real(m_owner->checked_column_index(column));}
+			boost::string_ref utf8(const wstring& column)const {return utf8(m_owner->checked_column_index(column));}
+			blob_ref blob(const wstring& column)const {return blob(m_owner->checked_column_index(column));}
+			bool is_null(const wstring& column)const {return is_null(m_owner->checked_column_index(column));}
+			//reads the row into a mapped struct. the select list must follow the mapping's column order.
+			template<class Record> void read(Record& r)const {record_mapper<Record>::read(m_stmt, r);}
+		};
+		class iterator : public std::iterator<std::input_iterator_tag, const row>
+		{
+		private:
+			cursor*		m_cursor;
+		public:
+			iterator(cursor* c = nullptr) : m_cursor(c) {}
+			const row& operator*()const {return m_cursor->current();}
+			const row* operator->()const {return &m_cursor->current();}
+			iterator& operator++()
+			{
+				if(false == m_cursor->next()) m_cursor = nullptr;
+				return *this;
+			}
+			bool operator==(const iterator& other)const {return m_cursor == other.m_cursor;}
+			bool operator!=(const iterator& other)const {return m_cursor != other.m_cursor;}
+		};
+
+	private:
+		std::function<void()>						m_release_connection;
+		std::function<void(sqlite3_stmt*, uint64_t, double)>	m_finished;
+		uint64_t									m_rows;
+		double										m_step_seconds;
+		std::unique_ptr<statement_cache::lease>		m_stmt;
+		column_name_index								m_column_names;
+		row											m_row;
+		bool										m_started;
+		bool										m_done;
+
+	public:
+		//release_connection is called once the statement has been given back, to hand the connection to the next user.
+		//finished, when given, receives the statement, the rows read and the time spent stepping just before the statement is given back.
+		cursor(std::unique_ptr<statement_cache::lease> stmt, const std::function<void()>& release_connection,
+			const std::function<void(sqlite3_stmt*, uint64_t, double)>& finished = nullptr)
+			: m_release_connection(release_connection), m_finished(finished), m_rows(0), m_step_seconds(0), m_stmt(std::move(stmt)), m_row(this), m_started(false), m_done(false)
+		{
+			m_row.m_stmt = m_stmt->get();
+			_load_columns();
+		}
+		~cursor() {close();}
+
+		//steps to the next row. returns false once the statement is exhausted or the cursor is closed.
+		bool next()
+		{
+			if(m_done) return false;
+			auto started = m_finished ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+			int ret = m_stmt->step();
+			if(m_finished)
+				m_step_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+			if(m_row.m_stmt != m_stmt->get())
+			{
+				m_row.m_stmt = m_stmt->get();
+				_load_columns();
+			}
+			m_started = true;
+			if(SQLITE_ROW == ret)
+			{
+				++m_rows;
+				return true;
+			}
+			string error = SQLITE_DONE == ret ? "" : sqlite3_errmsg(sqlite3_db_handle(m_row.m_stmt));
+			close();
+			if(error.size())
+				commit_error(codepage::acp_to_unicode(error));
+			return false;
+		}
+		//gives the statement back to the cache and releases the connection. safe to call more than once.
+		void close()
+		{
+			if(m_done) return;
+			m_done = true;
+			if(m_finished) m_finished(m_stmt->get(), m_rows, m_step_seconds);
+			m_stmt.reset();
+			m_row.m_stmt = nullptr;
+			if(m_release_connection) m_release_connection();
+		}
+		const row& current()const {return m_row;}
+		bool done()const {return m_done;}
+		iterator begin()
+		{
+			if(false == m_started && false == next()) return end();
+			return m_done ? end() : iterator(this);
+		}
+		iterator end() {return iterator();}
+
+		long column_number()const {return (long)sqlite3_column_count(m_row.m_stmt);}
+		wstring column_name(int column)const {return codepage::utf8_to_unicode(sqlite3_column_name(m_row.m_stmt, column));}
+		//the type the column was declared with in the schema, or nullptr for an expression.
+		const char* column_declared_type(int column)const {return sqlite3_column_decltype(m_row.m_stmt, column);}
+		int column_index(const wstring& column)const
+		{
+			auto itr = m_column_names.find(column);
+			return m_column_names.end() == itr ? -1 : itr->second;
+		}
+		int checked_column_index(const wstring& column)const
+		{
+			int index = column_index(column);
+			if(index < 0) commit_error(L"unknown column " + column);
+			return index;
+		}
+	private:
+		void _load_columns()
+		{
+			m_column_names.clear();
+			int column_count = sqlite3_column_count(m_row.m_stmt);
+			for(int i = 0; i < column_count; ++i)
+			{
+				auto name = codepage::utf8_to_unicode(sqlite3_column_name(m_row.m_stmt, i));
+				if(m_column_names.end() == m_column_names.find(name))
+					m_column_names[name] = i;
+			}
+		}
+	};
+	struct connection_pool_stats
+	{
+		size_t		readers;
+		uint64_t	reader_acquisitions;
+		uint64_t	reader_waits;
+		double		reader_wait_seconds;
+		double		reader_busy_seconds;
+		uint64_t	writer_acquisitions;
+		uint64_t	writer_waits;
+		double		writer_wait_seconds;
+		double		elapsed_seconds;
+
+		//fraction of the reader capacity that was in use since the pool was opened or reset.
+		double reader_utilization()const {return readers && elapsed_seconds > 0 ? reader_busy_seconds / (readers * elapsed_seconds) : 0;}
+	};
+	class reader_pool : boost::noncopyable
+	{
+	public:
+		//a reader is handed out to one thread at a time. reads nested in a read of the same thread share its reader.
+		struct reader
+		{
+			std::shared_ptr<sqlite3>	connection;
+			statement_cache				statements;
+			uint64_t					schema_generation;
+			boost::thread::id			holder;
+			size_t						leases;
+		};
+		class lease : boost::noncopyable
+		{
+		private:
+			reader_pool&	m_pool;
+			reader*			m_reader;
+			std::chrono::steady_clock::time_point	m_acquired;
+		public:
+			lease(reader_pool& pool) : m_pool(pool), m_reader(pool.acquire()), m_acquired(std::chrono::steady_clock::now()) {}
+			~lease() {m_pool.release(m_reader, m_acquired);}
+			reader* operator->()const {return m_reader;}
+			reader& operator*()const {return *m_reader;}
+		};
+		typedef std::chrono::steady_clock clock;
+
+	private:
+		vector<std::unique_ptr<reader>>	m_readers;
+		vector<reader*>					m_free;
+		vector<std::unique_ptr<reader>>	m_closing;
+		boost::mutex					m_mutex;
+		boost::condition_variable		m_available;
+		uint64_t						m_schema_generation;
+		connection_pool_stats			m_stats;
+		clock::time_point				m_since;
+
+	public:
+		reader_pool() : m_schema_generation(0) {reset_statistics();}
+
+		void open(const std::function<std::shared_ptr<sqlite3>()>& open_connection, size_t count)
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			for(size_t i = 0; i < count; ++i)
+			{
+				std::unique_ptr<reader> r(new reader);
+				r->connection = open_connection();
+				r->schema_generation = m_schema_generation;
+				r->leases = 0;
+				m_free.push_back(r.get());
+				m_readers.push_back(std::move(r));
+			}
+			m_stats.readers = m_readers.size();
+		}
+		//waits for every reader to be given back, then closes them. the readers the calling thread still holds
+		//can not be waited for, they are closed when it gives them back.
+		void close()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			auto held = _held_by(boost::this_thread::get_id());
+			while(m_free.size() + (held ? 1 : 0) != m_readers.size())
+				m_available.wait(lock);
+			BOOST_FOREACH(auto& it, m_readers)
+				if(it.get() == held) m_closing.push_back(std::move(it));
+			m_free.clear();
+			m_readers.clear();
+			m_stats.readers = 0;
+		}
+		bool empty()const {return m_readers.empty();}
+		//readers drop their cached statements the next time they are handed out.
+		void schema_changed()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			++m_schema_generation;
+		}
+		reader* acquire()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			++m_stats.reader_acquisitions;
+			auto held = _held_by(boost::this_thread::get_id());
+			if(held)
+			{
+				++held->leases;
+				return held;
+			}
+			if(m_free.empty())
+			{
+				++m_stats.reader_waits;
+				auto started = clock::now();
+				while(m_free.empty())
+					m_available.wait(lock);
+				m_stats.reader_wait_seconds += std::chrono::duration<double>(clock::now() - started).count();
+			}
+			auto r = m_free.back();
+			m_free.pop_back();
+			r->holder = boost::this_thread::get_id();
+			r->leases = 1;
+			if(r->schema_generation != m_schema_generation)
+			{
+				r->statements.clear();
+				r->schema_generation = m_schema_generation;
+			}
+			return r;
+		}
+		void release(reader* r, clock::time_point acquired)
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				if(0 != --r->leases) return;
+				r->holder = boost::thread::id();
+				for(auto itr = m_closing.begin(); m_closing.end() != itr; ++itr)
+					if(itr->get() == r)
+					{
+						m_closing.erase(itr);
+						return;
+					}
+				m_stats.reader_busy_seconds += std::chrono::duration<double>(clock::now() - acquired).count();
+				m_free.push_back(r);
+			}
+			m_available.notify_one();
+		}
+		void writer_acquired(bool waited, double wait_seconds)
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			++m_stats.writer_acquisitions;
+			if(waited)
+			{
+				++m_stats.writer_waits;
+				m_stats.writer_wait_seconds += wait_seconds;
+			}
+		}
+		connection_pool_stats statistics()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			auto stats = m_stats;
+			stats.elapsed_seconds = std::chrono::duration<double>(clock::now() - m_since).count();
+			return stats;
+		}
+		void reset_statistics()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			auto readers = m_readers.size();
+			m_stats = connection_pool_stats();
+			m_stats.readers = readers;
+			m_since = clock::now();
+		}
+	private:
+		reader* _held_by(boost::thread::id thread)const
+		{
+			BOOST_FOREACH(auto& it, m_readers)
+				if(it->leases && it->holder == thread) return it.get();
+			return nullptr;
+		}
+	};
+	//column-major result. each column keeps its cells contiguously: integers and reals in typed arrays, text and blobs
+	//as an offset array over one byte buffer, plus a validity bitmap. a column takes the storage type of its first
+	//non-null cell and is widened when a later cell does not fit it: integers to reals, numbers to text, text to
+	//blobs. cells that fit a wider column keep their value, e.g. numbers in a text column are stored as their text.
+	class columnar_table
+	{
+		friend class arrow_stream_writer;
+	public:
+		class column
+		{
+			friend class columnar_table;
+			friend class arrow_stream_writer;
+		private:
+			wstring					m_name;
+			int						m_type;
+			size_t					m_rows;
+			bool					m_fixed;
+			vector<uint8_t>			m_validity;
+			vector<int64_t>			m_integers;
+			vector<double>			m_reals;
+			vector<uint64_t>		m_offsets;
+			vector<char>			m_bytes;
+
+		public:
+			column(const wstring& name) : m_name(name), m_type(SQLITE_NULL), m_rows(0), m_fixed(false) {}
+
+			const wstring& name()const {return m_name;}
+			//SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB, or SQLITE_NULL while every cell is null.
+			int type()const {return m_type;}
+			size_t size()const {return m_rows;}
+			bool is_null(size_t row)const {return 0 == (m_validity[row >> 3] & (1 << (row & 7)));}
+			int64_t integer(size_t row)const {return m_integers[row];}
+			double real(size_t row)const {return m_reals[row];}
+			boost::string_ref utf8(size_t row)const
+			{
+				if(m_offsets.empty()) return boost::string_ref();
+				return boost::string_ref(m_bytes.data() + m_offsets[row], (size_t)(m_offsets[row + 1] - m_offsets[row]));
+			}
+			blob_ref blob(size_t row)const
+			{
+				if(m_offsets.empty()) return blob_ref();
+				return blob_ref(m_bytes.data() + m_offsets[row], (size_t)(m_offsets[row + 1] - m_offsets[row]));
+			}
+			wstring wtext(size_t row)const
+			{
+				auto text = utf8(row);
+				return codepage::utf8_to_unicode(string(text.begin(), text.end()));
+			}
+
+			const vector<uint8_t>& validity()const {return m_validity;}
+			const vector<int64_t>& integers()const {return m_integers;}
+			const vector<double>& reals()const {return m_reals;}
+			const vector<uint64_t>& offsets()const {return m_offsets;}
+			const vector<char>& bytes()const {return m_bytes;}
+
+		private:
+			void _reset()
+			{
+				m_rows = 0;
+				m_validity.clear();
+				m_integers.clear();
+				m_reals.clear();
+				m_bytes.clear();
+				m_offsets.assign(m_offsets.empty() ? 0 : 1, 0);
+			}
+			void _set_type(int type)
+			{
+				m_type = type;
+				switch(m_type)
+				{
+				case SQLITE_INTEGER: m_integers.assign(m_rows, 0); break;
+				case SQLITE_FLOAT: m_reals.assign(m_rows, 0); break;
+				default: m_offsets.assign(m_rows + 1, 0); break;
+				}
+			}
+			//text form of the numbers already read, as sqlite would give it
+			void _numbers_to_text()
+			{
+				vector<uint64_t> offsets(1, 0);
+				vector<char> bytes;
+				for(size_t row = 0; row < m_rows; ++row)
+				{
+					if(false == is_null(row))
+					{
+						string text;
+						if(SQLITE_INTEGER == m_type)
+							text = boost::lexical_cast<string>(m_integers[row]);
+						else
+						{
+							std::ostringstream out;
+							out.precision(15);
+							out << m_reals[row];
+							text = out.str();
+							if(std::isfinite(m_reals[row]) && string::npos == text.find_first_of(".e")) text += ".0";
+						}
+						bytes.insert(bytes.end(), text.begin(), text.end());
+					}
+					offsets.push_back(bytes.size());
+				}
+				m_integers.clear();
+				m_reals.clear();
+				m_offsets.swap(offsets);
+				m_bytes.swap(bytes);
+				m_type = SQLITE_TEXT;
+			}
+			void _widen(int type)
+			{
+				bool numeric = SQLITE_INTEGER == m_type || SQLITE_FLOAT == m_type;
+				bool wider = (SQLITE_INTEGER == m_type && SQLITE_FLOAT == type) || (numeric && (SQLITE_TEXT == type || SQLITE_BLOB == type)) ||
+					(SQLITE_TEXT == m_type && SQLITE_BLOB == type);
+				if(false == wider) return;
+				if(SQLITE_INTEGER == m_type && SQLITE_FLOAT == type)
+				{
+					m_reals.assign(m_integers.begin(), m_integers.end());
+					m_integers.clear();
+					m_type = SQLITE_FLOAT;
+					return;
+				}
+				if(numeric) _numbers_to_text();
+				if(SQLITE_BLOB == type) m_type = SQLITE_BLOB;
+			}
+			void _append(const cursor::row& r, int index)
+			{
+				bool valid = false == r.is_null(index);
+				if(valid && SQLITE_NULL == m_type)
+					_set_type(r.type(index));
+				else if(valid && m_type != r.type(index) && false == m_fixed)
+					_widen(r.type(index));
+				if(0 == (m_rows & 7))
+					m_validity.push_back(0);
+				if(valid)
+					m_validity.back() |= (uint8_t)(1 << (m_rows & 7));
+				switch(m_type)
+				{
+				case SQLITE_INTEGER: m_integers.push_back(valid ? r.integer(index) : 0); break;
+				case SQLITE_FLOAT: m_reals.push_back(valid ? r.real(index) : 0); break;
+				case SQLITE_TEXT:
+					if(valid)
+					{
+						auto text = r.utf8(index);
+						m_bytes.insert(m_bytes.end(), text.begin(), text.end());
+					}
+					m_offsets.push_back(m_bytes.size());
+					break;
+				case SQLITE_BLOB:
+					if(valid)
+					{
+						auto data = r.blob(index);
+						m_bytes.insert(m_bytes.end(), data.begin(), data.end());
+					}
+					m_offsets.push_back(m_bytes.size());
+					break;
+				}
+				++m_rows;
+			}
+		};
+
+	private:
+		vector<column>			m_columns;
+		column_name_index			m_column_names;
+		size_t					m_rows;
+
+	public:
+		columnar_table() : m_rows(0) {}
+
+		void clear()
+		{
+			m_columns.clear();
+			m_column_names.clear();
+			m_rows = 0;
+		}
+		long column_number()const {return (long)m_columns.size();}
+		long row_number()const {return (long)m_rows;}
+		const column& operator [](int index)const {return m_columns[index];}
+		const column& operator [](const wstring& name)const
+		{
+			auto itr = m_column_names.find(name);
+			if(m_column_names.end() == itr) commit_error(L"unknown column " + name);
+			return m_columns[itr->second];
+		}
+		const column& operator [](const string& name)const {return operator[](narrow_to_unicode(name));}
+
+		//drains c into the table, replacing what it held. returns the number of rows read.
+		size_t fill(cursor& c) {return _fill(c, (size_t)-1);}
+		//reads the next max_rows rows of c, replacing the previous batch. the columns keep the types they took in
+		//the first batch, so a large result can be read in bounded slices. a later cell of another type is converted
+		//to the type of its column as sqlite converts it, e.g. text in an integer column through sqlite3_column_int64.
+		size_t fill_batch(cursor& c, size_t max_rows)
+		{
+			if(m_columns.empty()) return _fill(c, max_rows);
+			BOOST_FOREACH(auto& it, m_columns)
+			{
+				it._reset();
+				it.m_fixed = it.m_fixed || SQLITE_NULL != it.m_type;
+			}
+			m_rows = 0;
+			return _read(c, max_rows);
+		}
+
+	private:
+		size_t _fill(cursor& c, size_t max_rows)
+		{
+			_add_columns(c);
+			return _read(c, max_rows);
+		}
+		//starts a batched read of c whose columns keep the given types from the first batch on. SQLITE_NULL leaves a
+		//column to take the type of its first cell.
+		void _declare(cursor& c, const vector<int>& types)
+		{
+			_add_columns(c);
+			for(size_t i = 0; i < m_columns.size() && i < types.size(); ++i)
+				_fix_type(i, types[i]);
+		}
+		void _fix_type(size_t index, int type)
+		{
+			if(SQLITE_NULL == type) return;
+			m_columns[index]._set_type(type);
+			m_columns[index].m_fixed = true;
+		}
+		void _add_columns(cursor& c)
+		{
+			clear();
+			for(int i = 0; i < c.column_number(); ++i)
+			{
+				m_columns.push_back(column(c.column_name(i)));
+				auto& name = m_columns.back().name();
+				if(m_column_names.end() == m_column_names.find(name))
+					m_column_names[name] = i;
+			}
+		}
+		size_t _read(cursor& c, size_t max_rows)
+		{
+			while(m_rows < max_rows && c.next())
+			{
+				for(int i = 0; i < (int)m_columns.size(); ++i)
+					m_columns[i]._append(c.current(), i);
+				++m_rows;
+			}
+			return m_rows;
+		}
+	};
+	struct export_stats
+	{
+		uint64_t	rows;
+		uint64_t	batches;
+		uint64_t	bytes;
+		double		seconds;
+	};
+	//writes query results as an arrow ipc stream: a schema message, one record batch per batch_rows rows and the
+	//end-of-stream marker. integers map to int64, reals to double, text to large_utf8 and blobs to large_binary, so
+	//the columnar_table buffers are written out as they are. assumes a little-endian host.
+	class arrow_stream_writer : boost::noncopyable
+	{
+	private:
+		//just enough of a flatbuffers builder for arrow message headers. the buffer grows towards the front, and
+		//positions are counted from the end as in the reference builder.
+		class flat_builder
+		{
+		private:
+			vector<uint8_t>					m_data;
+			vector<pair<int, uint32_t>>		m_fields;
+			uint32_t						m_table_start;
+
+		public:
+			flat_builder() : m_table_start(0) {}
+			uint32_t size()const {return (uint32_t)m_data.size();}
+			const vector<uint8_t>& data()const {return m_data;}
+			void align(size_t length, size_t alignment)
+			{
+				m_data.insert(m_data.begin(), (alignment - (m_data.size() + length) % alignment) % alignment, 0);
+			}
+			void prepend(const void* data, size_t length)
+			{
+				m_data.insert(m_data.begin(), (const uint8_t*)data, (const uint8_t*)data + length);
+			}
+			template<class Type> uint32_t push(Type value)
+			{
+				align(sizeof(Type), sizeof(Type));
+				prepend(&value, sizeof(Type));
+				return size();
+			}
+			uint32_t push_offset(uint32_t target)
+			{
+				align(4, 4);
+				return push<uint32_t>(size() + 4 - target);
+			}
+			uint32_t string(const std::string& s)
+			{
+				align(s.size() + 1 + 4, 4);
+				m_data.insert(m_data.begin(), 0);
+				prepend(s.data(), s.size());
+				return push<uint32_t>((uint32_t)s.size());
+			}
+			uint32_t offsets(const vector<uint32_t>& targets)
+			{
+				align(targets.size() * 4 + 4, 4);
+				for(auto itr = targets.rbegin(); targets.rend() != itr; ++itr)
+					push_offset(*itr);
+				return push<uint32_t>((uint32_t)targets.size());
+			}
+			//a vector of 16-byte structs made of two int64 each.
+			uint32_t pairs(const vector<pair<int64_t, int64_t>>& items)
+			{
+				align(items.size() * 16, 8);
+				for(auto itr = items.rbegin(); items.rend() != itr; ++itr)
+				{
+					prepend(&itr->second, 8);
+					prepend(&itr->first, 8);
+				}
+				return push<uint32_t>((uint32_t)items.size());
+			}
+			void start_table()
+			{
+				m_fields.clear();
+				m_table_start = size();
+			}
+			template<class Type> void field(int id, Type value) {m_fields.push_back(make_pair(id, push(value)));}
+			void offset_field(int id, uint32_t target) {m_fields.push_back(make_pair(id, push_offset(target)));}
+			uint32_t end_table()
+			{
+				uint32_t table = push<int32_t>(0);
+				int count = 0;
+				BOOST_FOREACH(auto& it, m_fields)
+					count = (std::max)(count, it.first + 1);
+				vector<uint16_t> vtable(2 + count, 0);
+				vtable[0] = (uint16_t)(vtable.size() * 2);
+				vtable[1] = (uint16_t)(table - m_table_start);
+				BOOST_FOREACH(auto& it, m_fields)
+					vtable[2 + it.first] = (uint16_t)(table - it.second);
+				align(vtable.size() * 2, 2);
+				prepend(vtable.data(), vtable.size() * 2);
+				int32_t vtable_offset = (int32_t)(size() - table);
+				memcpy(&m_data[m_data.size() - table], &vtable_offset, 4);
+				return table;
+			}
+			void finish(uint32_t root)
+			{
+				align(4, 8);
+				push_offset(root);
+			}
+		};
+		enum {schema_header = 1, record_batch_header = 3, metadata_v5 = 4};
+		enum {type_int = 2, type_floating_point = 3, type_large_binary = 19, type_large_utf8 = 20};
+
+		std::ostream&		m_out;
+		export_stats		m_stats;
+
+	public:
+		explicit arrow_stream_writer(std::ostream& out) : m_out(out)
+		{
+			export_stats stats = {0, 0, 0, 0};
+			m_stats = stats;
+		}
+		const export_stats& statistics()const {return m_stats;}
+		//drains c in slices of batch_rows, so memory stays bounded by one batch whatever the size of the result.
+		//the schema can not change once written, so a column declared with integer, real or text affinity takes its
+		//type from the declaration, and any other column from its cells in the first batch. cells that do not fit
+		//the type of their column are converted to it as sqlite converts them, and the export never fails halfway
+		//over a type.
+		export_stats write(cursor& c, size_t batch_rows = 65536)
+		{
+			auto started = std::chrono::steady_clock::now();
+			vector<int> declared, affinity;
+			for(int i = 0; i < c.column_number(); ++i)
+			{
+				declared.push_back(_declared_type(c.column_declared_type(i)));
+				affinity.push_back(_affinity_type(c.column_declared_type(i)));
+			}
+			columnar_table batch;
+			batch._declare(c, affinity);
+			bool first = true;
+			size_t rows;
+			while(0 != (rows = batch.fill_batch(c, batch_rows)) || first)
+			{
+				if(first)
+				{
+					//columns without a value in the first batch take their declared type
+					for(int i = 0; i < batch.column_number(); ++i)
+						if(SQLITE_NULL == batch[i].type())
+							batch._fix_type(i, declared[i]);
+					_write_schema(batch);
+					first = false;
+				}
+				if(0 == rows) break;
+				_write_batch(batch);
+			}
+			uint32_t end[2] = {0xffffffff, 0};
+			_write(end, sizeof(end));
+			m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+			return m_stats;
+		}
+
+	private:
+		//the type of a column with integer, real or text affinity, by the rules of sqlite. numeric affinity and
+		//columns without a declared type hold values of any type, and give SQLITE_NULL.
+		static int _affinity_type(const char* declared)
+		{
+			auto type = boost::to_lower_copy(string(declared ? declared : ""));
+			if(string::npos != type.find("int")) return SQLITE_INTEGER;
+			if(string::npos != type.find("char") || string::npos != type.find("clob") || string::npos != type.find("text")) return SQLITE_TEXT;
+			if(type.empty() || string::npos != type.find("blob")) return SQLITE_NULL;
+			if(string::npos != type.find("real") || string::npos != type.find("floa") || string::npos != type.find("doub")) return SQLITE_FLOAT;
+			return SQLITE_NULL;
+		}
+		static int _declared_type(const char* declared)
+		{
+			auto type = boost::to_lower_copy(string(declared ? declared : ""));
+			if(string::npos != type.find("int")) return SQLITE_INTEGER;
+			if(string::npos != type.find("real") || string::npos != type.find("floa") || string::npos != type.find("doub")) return SQLITE_FLOAT;
+			if(string::npos != type.find("blob")) return SQLITE_BLOB;
+			return SQLITE_TEXT;
+		}
+		void _write(const void* data, size_t length)
+		{
+			m_out.write((const char*)data, length);
+			m_stats.bytes += length;
+		}
+		void _write_padding(size_t length)
+		{
+			static const char zeros[8] = {0};
+			if(length % 8) _write(zeros, 8 - length % 8);
+		}
+		void _write_message(flat_builder& fb, uint8_t header_type, uint32_t header, int64_t body_length)
+		{
+			fb.start_table();
+			fb.field<int16_t>(0, metadata_v5);
+			fb.field<uint8_t>(1, header_type);
+			fb.offset_field(2, header);
+			fb.field<int64_t>(3, body_length);
+			fb.finish(fb.end_table());
+			uint32_t prefix[2] = {0xffffffff, (fb.size() + 7) & ~7u};
+			_write(prefix, sizeof(prefix));
+			_write(fb.data().data(), fb.size());
+			_write_padding(fb.size());
+			if(!m_out) commit_error(L"cannot write the arrow stream.");
+		}
+		void _write_schema(const columnar_table& batch)
+		{
+			flat_builder fb;
+			vector<uint32_t> fields;
+			for(int i = 0; i < batch.column_number(); ++i)
+			{
+				auto& column = batch[i];
+				uint32_t name = fb.string(codepage::unicode_to_utf8(column.name()));
+				fb.start_table();
+				uint8_t type_type = type_large_utf8;
+				switch(column.type())
+				{
+				case SQLITE_INTEGER:
+					fb.field<int32_t>(0, 64);
+					fb.field<uint8_t>(1, 1);
+					type_type = type_int;
+					break;
+				case SQLITE_FLOAT:
+					fb.field<int16_t>(0, 2);
+					type_type = type_floating_point;
+					break;
+				case SQLITE_BLOB:
+					type_type = type_large_binary;
+					break;
+				}
+				uint32_t type = fb.end_table();
+				uint32_t children = fb.offsets(vector<uint32_t>());
+				fb.start_table();
+				fb.offset_field(0, name);
+				fb.field<uint8_t>(1, 1);
+				fb.field<uint8_t>(2, type_type);
+				fb.offset_field(3, type);
+				fb.offset_field(5, children);
+				fields.push_back(fb.end_table());
+			}
+			uint32_t field_vector = fb.offsets(fields);
+			fb.start_table();
+			fb.field<int16_t>(0, 0);
+			fb.offset_field(1, field_vector);
+			_write_message(fb, schema_header, fb.end_table(), 0);
+		}
+		void _write_batch(const columnar_table& batch)
+		{
+			vector<pair<int64_t, int64_t>> nodes, buffers;
+			vector<pair<const void*, size_t>> body;
+			int64_t body_length = 0;
+			auto add_buffer = [&](const void* data, size_t length)
+			{
+				buffers.push_back(make_pair(body_length, (int64_t)length));
+				body.push_back(make_pair(data, length));
+				body_length += (length + 7) & ~(size_t)7;
+			};
+			for(int i = 0; i < batch.column_number(); ++i)
+			{
+				auto& column = batch[i];
+				int64_t nulls = 0;
+				for(size_t row = 0; row < column.size(); ++row)
+					if(column.is_null(row)) ++nulls;
+				nodes.push_back(make_pair((int64_t)column.size(), nulls));
+				add_buffer(column.validity().data(), nulls ? column.validity().size() : 0);
+				switch(column.type())
+				{
+				case SQLITE_INTEGER: add_buffer(column.integers().data(), column.integers().size() * sizeof(int64_t)); break;
+				case SQLITE_FLOAT: add_buffer(column.reals().data(), column.reals().size() * sizeof(double)); break;
+				default:
+					add_buffer(column.offsets().data(), column.offsets().size() * sizeof(uint64_t));
+					add_buffer(column.bytes().data(), column.bytes().size());
+					break;
+				}
+			}
+			flat_builder fb;
+			uint32_t buffer_vector = fb.pairs(buffers);
+			uint32_t node_vector = fb.pairs(nodes);
+			fb.start_table();
+			fb.field<int64_t>(0, (int64_t)batch.row_number());
+			fb.offset_field(1, node_vector);
+			fb.offset_field(2, buffer_vector);
+			_write_message(fb, record_batch_header, fb.end_table(), body_length);
+			BOOST_FOREACH(auto& it, body)
+			{
+				_write(it.first, it.second);
+				_write_padding(it.second);
+			}
+			if(!m_out) commit_error(L"cannot write the arrow stream.");
+			m_stats.rows += batch.row_number();
+			++m_stats.batches;
+		}
+	};
+	struct statement_profile
+	{
+		uint64_t	executions;
+		double		total_seconds;
+		double		prepare_seconds;
+		double		step_seconds;
+		double		max_seconds;
+		uint64_t	rows;
+		uint64_t	changes;
+		//read from sqlite3_stmt_status, so they stay zero when sqlite.hpp is built against an older sqlite3.h:
+		//fullscan_steps and sorts need 3.6.4, autoindexes 3.7.0 and vm_steps 3.14.0.
+		uint64_t	fullscan_steps;
+		uint64_t	sorts;
+		uint64_t	autoindexes;
+		uint64_t	vm_steps;
+	};
+	//replaces numeric and quoted literals with ? and collapses whitespace, so statements that differ only in their
+	//literal values share one profile.
+	inline string normalize_sql(const string& sql)
+	{
+		string normalized;
+		normalized.reserve(sql.size());
+		for(size_t i = 0; i < sql.size();)
+		{
+			char c = sql[i];
+			if('\'' == c || '"' == c)
+			{
+				size_t end = i + 1;
+				for(; end < sql.size(); ++end)
+					if(sql[end] == c && (end + 1 == sql.size() || sql[end + 1] != c)) break;
+					else if(sql[end] == c) ++end;
+				if('"' == c) normalized.append(sql, i, end + 1 - i);
+				else normalized += '?';
+				i = end + 1;
+			}
+			else if(isdigit((unsigned char)c) && (normalized.empty() || !(isalnum((unsigned char)normalized.back()) || '_' == normalized.back())))
+			{
+				while(i < sql.size() && (isalnum((unsigned char)sql[i]) || '.' == sql[i])) ++i;
+				normalized += '?';
+			}
+			else if(isspace((unsigned char)c))
+			{
+				while(i < sql.size() && isspace((unsigned char)sql[i])) ++i;
+				if(normalized.size() && i < sql.size()) normalized += ' ';
+			}
+			else
+			{
+				normalized += c;
+				++i;
+			}
+		}
+		return normalized;
+	}
+	class statement_registry : boost::noncopyable
+	{
+	private:
+		boost::mutex								m_mutex;
+		unordered_map<string, statement_profile>	m_profiles;
+
+	public:
+		void record(const string& sql, sqlite3_stmt* stmt, double prepare_seconds, double step_seconds, uint64_t rows, uint64_t changes)
+		{
+			auto key = normalize_sql(sql);
+			statement_profile sample = statement_profile();
+#if SQLITE_VERSION_NUMBER < 3006004
+			(void)stmt;
+#else
+			sample.fullscan_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+			sample.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+#endif
+#if SQLITE_VERSION_NUMBER >= 3007000
+			sample.autoindexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+#endif
+#if SQLITE_VERSION_NUMBER >= 3014000
+			sample.vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+#endif
+			double seconds = prepare_seconds + step_seconds;
+
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			auto& profile = m_profiles[key];
+			++profile.executions;
+			profile.total_seconds += seconds;
+			profile.prepare_seconds += prepare_seconds;
+			profile.step_seconds += step_seconds;
+			profile.max_seconds = (std::max)(profile.max_seconds, seconds);
+			profile.rows += rows;
+			profile.changes += changes;
+			profile.fullscan_steps += sample.fullscan_steps;
+			profile.sorts += sample.sorts;
+			profile.autoindexes += sample.autoindexes;
+			profile.vm_steps += sample.vm_steps;
+		}
+		map<string, statement_profile> snapshot()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			return map<string, statement_profile>(m_profiles.begin(), m_profiles.end());
+		}
+		void reset()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			m_profiles.clear();
+		}
+	};
+	struct result_cache_stats
+	{
+		uint64_t	hits;
+		uint64_t	misses;
+		uint64_t	evictions;
+		uint64_t	invalidations;
+		size_t		entries;
+		size_t		bytes;
+		size_t		capacity;
+	};
+	//immutable query results shared between readers, keyed by sql text and bound values. entries are dropped when a
+	//transaction that changed one of the tables they read commits, and the least recently used ones go first when
+	//the byte budget is exceeded. only changes made through the owning dao are seen.
+	class result_cache : boost::noncopyable
+	{
+	private:
+		struct entry
+		{
+			std::shared_ptr<const table>	rows;
+			size_t							bytes;
+			vector<string>					tables;
+		};
+		typedef list<pair<string, entry>>	entry_list;
+
+		boost::mutex								m_mutex;
+		entry_list									m_entries;
+		unordered_map<string, entry_list::iterator>	m_index;
+		unordered_map<string, vector<string>>		m_dependencies;
+		std::atomic<size_t>							m_capacity;
+		size_t										m_bytes;
+		uint64_t									m_generation;
+		vector<string>								m_changed;
+		uint64_t									m_hits;
+		uint64_t									m_misses;
+		uint64_t									m_evictions;
+		uint64_t									m_invalidations;
+
+	public:
+		result_cache() : m_capacity(0), m_bytes(0), m_generation(0), m_hits(0), m_misses(0), m_evictions(0), m_invalidations(0) {}
+
+		bool enabled()const {return 0 != m_capacity;}
+		void set_capacity(size_t bytes)
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			m_capacity = bytes;
+			_evict(0);
+		}
+		//generation is to be handed back to store, which drops results read while a change was being committed.
+		std::shared_ptr<const table> find(const string& key, uint64_t& generation)
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			generation = m_generation;
+			auto itr = m_index.find(key);
+			if(m_index.end() == itr)
+			{
+				++m_misses;
+				return nullptr;
+			}
+			++m_hits;
+			m_entries.splice(m_entries.begin(), m_entries, itr->second);
+			return itr->second->second.rows;
+		}
+		void store(const string& key, const std::shared_ptr<const table>& rows, const vector<string>& tables, uint64_t generation)
+		{
+			entry e = {rows, _bytes(*rows), tables};
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			if(generation != m_generation || e.bytes > m_capacity || m_index.count(key)) return;
+			_evict(e.bytes);
+			m_entries.push_front(make_pair(key, e));
+			m_index[key] = m_entries.begin();
+			m_bytes += e.bytes;
+		}
+		bool dependencies(const string& sql, vector<string>& tables)
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			auto itr = m_dependencies.find(sql);
+			if(m_dependencies.end() == itr) return false;
+			tables = itr->second;
+			return true;
+		}
+		void set_dependencies(const string& sql, const vector<string>& tables)
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			m_dependencies[sql] = tables;
+		}
+		//called for every changed row, so repeated changes to the same table cost one comparison.
+		void changed(const char* table)
+		{
+			if(m_changed.size() && boost::iequals(m_changed.back(), table)) return;
+			auto name = boost::to_lower_copy(string(table));
+			if(m_changed.end() == std::find(m_changed.begin(), m_changed.end(), name))
+				m_changed.push_back(name);
+		}
+		void committed()
+		{
+			if(m_changed.empty()) return;
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			++m_generation;
+			for(auto itr = m_entries.begin(); m_entries.end() != itr;)
+			{
+				bool stale = false;
+				BOOST_FOREACH(auto& it, itr->second.tables)
+					if(m_changed.end() != std::find(m_changed.begin(), m_changed.end(), it)) stale = true;
+				if(stale)
+				{
+					++m_invalidations;
+					itr = _erase(itr);
+				}
+				else ++itr;
+			}
+			m_changed.clear();
+		}
+		void rolled_back() {m_changed.clear();}
+		void clear()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			++m_generation;
+			m_invalidations += m_entries.size();
+			m_entries.clear();
+			m_index.clear();
+			m_dependencies.clear();
+			m_bytes = 0;
+		}
+		result_cache_stats statistics()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			result_cache_stats stats = {m_hits, m_misses, m_evictions, m_invalidations, m_entries.size(), m_bytes, m_capacity};
+			return stats;
+		}
+		void reset_statistics()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			m_hits = m_misses = m_evictions = m_invalidations = 0;
+		}
+
+	private:
+		entry_list::iterator _erase(entry_list::iterator itr)
+		{
+			m_bytes -= itr->second.bytes;
+			m_index.erase(itr->first);
+			return m_entries.erase(itr);
+		}
+		void _evict(size_t incoming)
+		{
+			while(m_entries.size() && m_bytes + incoming > m_capacity)
+			{
+				_erase(--m_entries.end());
+				++m_evictions;
+			}
+		}
+		//an estimate of the heap held by rows.
+		static size_t _bytes(const table& rows)
+		{
+			size_t bytes = sizeof(table) + rows.column_number() * 64;
+			for(long i = 0; i < rows.row_number(); ++i)
+			{
+				bytes += sizeof(table::record) + rows.column_number() * sizeof(value_t);
+				for(long j = 0; j < rows.column_number(); ++j)
+				{
+					auto& v = (const __value_t&)rows[i][j];
+					if(value_t::text_value == v.which()) bytes += boost::get<text_t>(v).capacity() * sizeof(text_t::value_type);
+					else if(value_t::blob_value == v.which()) bytes += boost::get<vector<char>>(v).capacity();
+				}
+			}
+			return bytes;
+		}
+	};
+	//one committed row change. values holds the new row for inserts and updates and the old row for deletes, and is
+	//only filled when sqlite is built with SQLITE_ENABLE_PREUPDATE_HOOK and the feed asked for it.
+	struct change_event
+	{
+		uint64_t			sequence;
+		int					op;			//SQLITE_INSERT, SQLITE_UPDATE or SQLITE_DELETE
+		string				table;
+		int64_t				rowid;
+		vector<value_t>		values;
+	};
+	//a bounded lock-free queue of committed changes with a single producer, the committing connection, and a single
+	//consumer. every subscriber gets its own feed. when a feed is full the producer drops events instead of waiting,
+	//and counts them in dropped().
+	class change_feed : boost::noncopyable
+	{
+		friend class dao;
+	private:
+		vector<change_event>		m_slots;
+		size_t						m_mask;
+		bool						m_values;
+		std::atomic<uint64_t>		m_head;
+		std::atomic<uint64_t>		m_tail;
+		std::atomic<uint64_t>		m_dropped;
+
+	public:
+		//capacity is rounded up to a power of two.
+		change_feed(size_t capacity, bool values) : m_values(values), m_head(0), m_tail(0), m_dropped(0)
+		{
+			size_t size = 2;
+			while(size < capacity) size <<= 1;
+			m_slots.resize(size);
+			m_mask = size - 1;
+		}
+		size_t capacity()const {return m_slots.size();}
+		size_t size()const {return (size_t)(m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed));}
+		uint64_t dropped()const {return m_dropped.load(std::memory_order_relaxed);}
+		bool try_pop(change_event& e)
+		{
+			auto tail = m_tail.load(std::memory_order_relaxed);
+			if(tail == m_head.load(std::memory_order_acquire)) return false;
+			e = std::move(m_slots[tail & m_mask]);
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		void _push(const change_event& e)
+		{
+			auto head = m_head.load(std::memory_order_relaxed);
+			if(head - m_tail.load(std::memory_order_acquire) == m_slots.size())
+			{
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			auto& slot = m_slots[head & m_mask];
+			slot = e;
+			if(false == m_values) slot.values.clear();
+			m_head.store(head + 1, std::memory_order_release);
+		}
+	};
+	struct async_options
+	{
+		size_t		workers;
+		size_t		queue_capacity;
+		bool		block_when_full;	//otherwise a full queue fails the returned future at once
+	};
+	//each worker holds a reference to the executor, so a task that ends up stopping the executor from its own worker,
+	//e.g. by dropping the last reference to the dao, does not destroy it under that worker.
+	class task_executor : boost::noncopyable
+	{
+	private:
+		deque<std::function<void()>>	m_tasks;
+		boost::mutex					m_mutex;
+		boost::condition_variable		m_not_empty;
+		boost::condition_variable		m_not_full;
+		vector<std::unique_ptr<boost::thread>>	m_workers;
+		size_t							m_capacity;
+		bool							m_stopping;
+
+		explicit task_executor(size_t capacity) : m_capacity(capacity ? capacity : 1), m_stopping(false) {}
+
+	public:
+		static std::shared_ptr<task_executor> create(size_t workers, size_t capacity)
+		{
+			std::shared_ptr<task_executor> executor(new task_executor(capacity));
+			for(size_t i = 0; i < (workers ? workers : 1); ++i)
+			{
+				auto self = executor;
+				executor->m_workers.push_back(std::unique_ptr<boost::thread>(new boost::thread([self]() mutable
+				{
+					self->_run();
+					self.reset();
+				})));
+			}
+			return executor;
+		}
+		~task_executor() {stop();}
+
+		//queues task. when the queue is full, either waits for room or returns false.
+		bool submit(const std::function<void()>& task, bool wait)
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				while(false == m_stopping && m_tasks.size() >= m_capacity)
+				{
+					if(false == wait) return false;
+					m_not_full.wait(lock);
+				}
+				if(m_stopping) return false;
+				m_tasks.push_back(task);
+			}
+			m_not_empty.notify_one();
+			return true;
+		}
+		//runs what is already queued, then joins the workers. called from a worker, the other workers drain the queue,
+		//and whatever is left once they are done is dropped, so the futures of those tasks report a broken promise.
+		void stop()
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				m_stopping = true;
+			}
+			m_not_empty.notify_all();
+			m_not_full.notify_all();
+			bool from_worker = false;
+			BOOST_FOREACH(auto& worker, m_workers)
+			{
+				if(boost::this_thread::get_id() == worker->get_id())
+				{
+					worker->detach();
+					from_worker = true;
+				}
+				else if(worker->joinable()) worker->join();
+			}
+			m_workers.clear();
+			if(from_worker)
+			{
+				deque<std::function<void()>> abandoned;
+				{
+					boost::unique_lock<boost::mutex> lock(m_mutex);
+					abandoned.swap(m_tasks);
+				}
+			}
+		}
+		size_t pending()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			return m_tasks.size();
+		}
+
+	private:
+		void _run()
+		{
+			for(;;)
+			{
+				std::function<void()> task;
+				{
+					boost::unique_lock<boost::mutex> lock(m_mutex);
+					while(false == m_stopping && m_tasks.empty())
+						m_not_empty.wait(lock);
+					if(m_tasks.empty()) return;
+					task = std::move(m_tasks.front());
+					m_tasks.pop_front();
+				}
+				m_not_full.notify_one();
+				task();
+			}
+		}
+	};
+	struct group_commit_options
+	{
+		size_t							max_batch;		//writes per transaction
+		size_t							max_bytes;		//estimated payload per transaction
+		std::chrono::microseconds		max_delay;		//how long the first write of a batch may wait for company
+		size_t							queue_capacity;	//submitters wait while this many writes are queued
+	};
+	struct group_commit_stats
+	{
+		uint64_t	batches;
+		uint64_t	writes;
+		uint64_t	failures;
+
+		double writes_per_batch()const {return batches ? (double)writes / batches : 0;}
+	};
+	//collects writes from many threads for a single writer thread, which hands them to commit in batches.
+	class group_commit_queue : boost::noncopyable
+	{
+	public:
+		struct write
+		{
+			std::function<size_t()>					work;
+			size_t									bytes;
+			std::shared_ptr<std::promise<size_t>>	promise;
+		};
+
+	private:
+		deque<write>								m_writes;
+		boost::mutex								m_mutex;
+		boost::condition_variable					m_not_empty;
+		boost::condition_variable					m_not_full;
+		size_t										m_queued_bytes;
+		group_commit_options						m_options;
+		std::function<void(vector<write>&)>			m_commit;
+		group_commit_stats							m_stats;
+		bool										m_stopping;
+		std::unique_ptr<boost::thread>				m_writer;
+
+		group_commit_queue(const group_commit_options& options, const std::function<void(vector<write>&)>& commit)
+			: m_queued_bytes(0), m_options(options), m_commit(commit), m_stopping(false)
+		{
+			group_commit_stats stats = {0, 0, 0};
+			m_stats = stats;
+		}
+
+	public:
+		//the writer keeps the queue alive, so a write that releases the last owner of the queue cannot pull it out
+		//from under the writer.
+		static std::shared_ptr<group_commit_queue> create(const group_commit_options& options, const std::function<void(vector<write>&)>& commit)
+		{
+			std::shared_ptr<group_commit_queue> queue(new group_commit_queue(options, commit));
+			auto self = queue;
+			queue->m_writer.reset(new boost::thread([self]() mutable
+			{
+				self->_run();
+				self.reset();
+			}));
+			return queue;
+		}
+		~group_commit_queue() {stop();}
+
+		std::future<size_t> submit(const std::function<size_t()>& work, size_t bytes)
+		{
+			write w = {work, bytes, std::make_shared<std::promise<size_t>>()};
+			auto future = w.promise->get_future();
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				while(false == m_stopping && m_writes.size() >= m_options.queue_capacity)
+					m_not_full.wait(lock);
+				if(m_stopping)
+				{
+					w.promise->set_exception(std::make_exception_ptr(exception2() << error_wtext(L"the group commit queue is stopped")));
+					return future;
+				}
+				m_writes.push_back(std::move(w));
+				m_queued_bytes += bytes;
+			}
+			m_not_empty.notify_one();
+			return future;
+		}
+		//commits what is already queued, then joins the writer. called from the writer, the writes still queued fail,
+		//since whatever commits them may be going away.
+		void stop()
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				m_stopping = true;
+			}
+			m_not_empty.notify_all();
+			m_not_full.notify_all();
+			if(m_writer && m_writer->joinable())
+			{
+				if(boost::this_thread::get_id() != m_writer->get_id())
+				{
+					m_writer->join();
+					return;
+				}
+				m_writer->detach();
+				deque<write> abandoned;
+				{
+					boost::unique_lock<boost::mutex> lock(m_mutex);
+					abandoned.swap(m_writes);
+					m_queued_bytes = 0;
+				}
+				BOOST_FOREACH(auto& it, abandoned)
+					it.promise->set_exception(std::make_exception_ptr(exception2() << error_wtext(L"the group commit queue is stopped")));
+			}
+		}
+		group_commit_stats statistics()
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			return m_stats;
+		}
+
+	private:
+		bool _full()const {return m_writes.size() >= m_options.max_batch || m_queued_bytes >= m_options.max_bytes;}
+		void _run()
+		{
+			vector<write> batch;
+			for(;;)
+			{
+				{
+					boost::unique_lock<boost::mutex> lock(m_mutex);
+					while(false == m_stopping && m_writes.empty())
+						m_not_empty.wait(lock);
+					if(m_writes.empty()) return;
+					auto deadline = boost::get_system_time() + boost::posix_time::microseconds(m_options.max_delay.count());
+					while(false == m_stopping && false == _full())
+						if(false == m_not_empty.timed_wait(lock, deadline)) break;
+					size_t bytes = 0;
+					while(m_writes.size() && batch.size() < (std::max)(m_options.max_batch, (size_t)1) && (batch.empty() || bytes < m_options.max_bytes))
+					{
+						bytes += m_writes.front().bytes;
+						batch.push_back(std::move(m_writes.front()));
+						m_writes.pop_front();
+					}
+					m_queued_bytes -= bytes;
+				}
+				m_not_full.notify_all();
+				m_commit(batch);
+				{
+					boost::unique_lock<boost::mutex> lock(m_mutex);
+					++m_stats.batches;
+					m_stats.writes += batch.size();
+				}
+				batch.clear();
+			}
+		}
+	};
+#if SQLITE_VERSION_NUMBER >= 3004000
+	enum blob_mode {blob_read = 0, blob_write = 1};
+	//incremental access to one blob cell, so large objects move in chunks instead of whole vector<char> values.
+	//a blob cannot change its size through the stream; write a zeroblob(n) of the final size first.
+	//the connection stays taken until the stream is closed or destroyed.
+	class blob_stream : boost::noncopyable
+	{
+	private:
+		sqlite3_blob*				m_blob;
+		sqlite3*					m_connection;
+		std::function<void()>		m_release_connection;
+		size_t						m_position;
+
+	public:
+		blob_stream(sqlite3* connection, sqlite3_blob* blob, const std::function<void()>& release_connection)
+			: m_blob(blob), m_connection(connection), m_release_connection(release_connection), m_position(0) {}
+		~blob_stream() {close();}
+
+		size_t size()const {return m_blob ? (size_t)sqlite3_blob_bytes(m_blob) : 0;}
+		size_t tell()const {return m_position;}
+		void seek(size_t position) {m_position = (std::min)(position, size());}
+		bool eof()const {return m_position >= size();}
+		//reads up to bytes from the current position and returns how many were read.
+		size_t read(void* buffer, size_t bytes)
+		{
+			bytes = (std::min)(bytes, size() - m_position);
+			if(bytes && SQLITE_OK != sqlite3_blob_read(m_blob, buffer, (int)bytes, (int)m_position))
+				_commit_error();
+			m_position += bytes;
+			return bytes;
+		}
+		void write(const void* data, size_t bytes)
+		{
+			if(m_position + bytes > size())
+				commit_error(L"blob_stream cannot write past the end of the blob.");
+			if(bytes && SQLITE_OK != sqlite3_blob_write(m_blob, data, (int)bytes, (int)m_position))
+				_commit_error();
+			m_position += bytes;
+		}
+		//copies the rest of the blob to out, chunk bytes at a time.
+		uint64_t copy_to(std::ostream& out, size_t chunk = 1 << 20)
+		{
+			vector<char> buffer((std::min)(chunk, size() - m_position));
+			uint64_t copied = 0;
+			for(size_t n; 0 != (n = read(buffer.data(), buffer.size())); copied += n)
+				if(!out.write(buffer.data(), n)) commit_error(L"blob_stream cannot write to the output stream.");
+			return copied;
+		}
+		//fills the rest of the blob from in, chunk bytes at a time, until either runs out.
+		uint64_t copy_from(std::istream& in, size_t chunk = 1 << 20)
+		{
+			vector<char> buffer((std::min)(chunk, size() - m_position));
+			uint64_t copied = 0;
+			while(false == eof() && in)
+			{
+				in.read(buffer.data(), (std::min)(buffer.size(), size() - m_position));
+				size_t n = (size_t)in.gcount();
+				if(0 == n) break;
+				write(buffer.data(), n);
+				copied += n;
+			}
+			return copied;
+		}
+#if SQLITE_VERSION_NUMBER >= 3007004
+		//moves to the same column of another row without opening a new handle.
+		void reopen(int64_t rowid)
+		{
+			if(SQLITE_OK != sqlite3_blob_reopen(m_blob, rowid))
+				_commit_error();
+			m_position = 0;
+		}
+#endif
+		void close()
+		{
+			if(nullptr == m_blob) return;
+			sqlite3_blob_close(m_blob);
+			m_blob = nullptr;
+			if(m_release_connection)
+				m_release_connection();
+		}
+
+	private:
+		void _commit_error()
+		{
+			commit_error(codepage::acp_to_unicode(sqlite3_errmsg(m_connection)));
+		}
+	};
+#endif
+	//the limit clause for rows [start, start + count). count -1 is written as -1, which sqlite reads as no limit.
+	inline string limit_clause(uint64_t start, uint64_t count)
+	{
+		if(0 == start && (uint64_t)-1 == count) return string();
+		return (boost::format(" limit %1%, %2%") % start % (int64_t)count).str();
+	}
+	class dao : boost::noncopyable, public std::enable_shared_from_this<dao>
+	{
+		friend class transaction;
+	protected:
+		class transaction : noncopyable
+		{
+		private:
+			boost::recursive_mutex::scoped_lock	ul;
+			dao&						db;
+		public:
+			transaction(dao* d) : ul(d->m_connection_mutex), db(*d)
+			{
+				db.begin_transaction();
+			}
+			~transaction()
+			{
+				try
+				{
+					db.commit_transaction();
+				}
+				catch(...)
+				{
+					db.rollback_transaction();
+				}
+			}
+		};
+	public:
+		dao() : m_busy_timeout(-1), m_transaction_thread(boost::thread::id()), m_commit_staged(false), m_capture_changes(false), m_capture_values(false), m_preupdate_rowid(0), m_has_preupdate(false), m_change_sequence(0), m_read_tables(nullptr), m_profiling(false)
+		{
+			async_options options = {0, 1024, true};
+			m_async_options = options;
+			group_commit_options group = {1000, 4 << 20, std::chrono::microseconds(1000), 65536};
+			m_group_commit_options = group;
+		}
+		virtual ~dao() {close();}
+
+		//with readers > 0 the database is switched to WAL and that many extra read-only connections are opened.
+		//plain selects are then served by any free reader, while writes and transactions stay on the single writer.
+		//a reader pool needs an sqlite with wal and query_only (3.8.0 or later). the open fails when either is missing.
+		void open(const boost::filesystem::path& datasource, const wstring& password = L"", size_t readers = 0)
+		{
+			m_readers.close();
+			DeclareSection(m_connection_mutex);
+			m_statements.clear();
+			//a pool has its writer and readers contend for the file, so they wait for locks by default.
+			int busy_timeout = m_busy_timeout >= 0 ? m_busy_timeout : (readers ? 5000 : 0);
+			auto open_connection = [datasource, password, busy_timeout]()->std::shared_ptr<sqlite3>
+				{
+					sqlite3* connection = nullptr;
+					sqlite3_open(codepage::unicode_to_utf8(datasource.wstring()).c_str(), &connection);
+					if(nullptr != connection && false == password.empty())
+					{
+#if defined(SQLITE_HSD_SYSTEM_SQLITE) && !defined(SQLITE_HAS_CODEC)
+						sqlite3_close(connection);
+						commit_error(L"this sqlite has no codec, so it can not open a database with a password");
+#else
+						auto utf8_pwd = codepage::unicode_to_utf8(password);
+						sqlite3_key(connection, utf8_pwd.c_str(), (int)utf8_pwd.size());
+#endif
+					}
+					if(nullptr != connection && busy_timeout > 0)
+						sqlite3_busy_timeout(connection, busy_timeout);
+					return std::shared_ptr<sqlite3>(connection, sqlite3_close);
+				};
+			m_connection = open_connection();
+			m_datasource = datasource;
+			_install_hooks();
+
+			if(readers)
+			{
+				if(false == boost::iequals(_pragma(m_connection.get(), "journal_mode=wal"), "wal"))
+				{
+					m_connection = std::shared_ptr<sqlite3>();
+					commit_error(L"a reader pool needs the wal journal mode, which this sqlite or this database does not support");
+				}
+				try
+				{
+					m_readers.open([open_connection]()->std::shared_ptr<sqlite3>
+					{
+						auto connection = open_connection();
+						if("1" != _pragma(connection.get(), "query_only=1") && "1" != _pragma(connection.get(), "query_only"))
+							commit_error(L"a reader pool needs pragma query_only, which this sqlite does not support");
+						return connection;
+					}, readers);
+				}
+				catch(...)
+				{
+					m_readers.close();
+					m_connection = std::shared_ptr<sqlite3>();
+					throw;
+				}
+			}
+		}
+		//how long a connection waits for a lock held by another connection before failing with SQLITE_BUSY.
+		//applies to the connections opened by the next open. by default a dao with a reader pool waits up to 5 seconds,
+		//and one without fails at once.
+		void set_busy_timeout(int milliseconds) {m_busy_timeout = milliseconds;}
+		void close()
+		{
+			_stop_group_commit();
+			_stop_executor();
+			m_readers.close();
+			DeclareSection(m_connection_mutex);
+			m_statements.clear();
+			m_connection = std::shared_ptr<sqlite3>();
+		}
+		bool is_open()const {return m_connection != nullptr;}
+		boost::filesystem::path source()const {return m_datasource;}
+		size_t execute(const command& cmd, table* table = nullptr, uint64_t start = 0, uint64_t count = -1)
+		{
+			if(false == is_open()) _commit_error("data base is not open");
+			auto text = _command_text(cmd, start, count);
+			if(_is_reader_statement(text))
+			{
+				reader_pool::lease reader(m_readers);
+				return _execute(reader->connection.get(), reader->statements, text, cmd, table);
+			}
+			auto lock = _lock_writer();
+			if(false == is_open()) _commit_error("data base is not open");
+			auto changes = _execute(m_connection.get(), m_statements, text, cmd, table);
+			_settle_commit();
+			if(_is_schema_change(text))
+				_schema_changed();
+			return changes;
+		}
+		size_t execute(const command& cmd, columnar_table& table, uint64_t start = 0, uint64_t count = -1)
+		{
+			auto c = query(cmd, start, count);
+			return table.fill(*c);
+		}
+		//opens a forward-only cursor over cmd. the connection stays taken until the cursor is exhausted, closed or destroyed.
+		//the cursor keeps a dao owned by a shared_ptr alive. any other dao must outlive its cursors.
+		std::unique_ptr<cursor> query(const command& cmd, uint64_t start = 0, uint64_t count = -1)
+		{
+			if(false == is_open()) _commit_error("data base is not open");
+			auto text = _command_text(cmd, start, count);
+			if(_is_reader_statement(text))
+			{
+				auto reader = std::make_shared<reader_pool::lease>(m_readers);
+				auto started = std::chrono::steady_clock::now();
+				auto stmt = _prepare((*reader)->connection.get(), (*reader)->statements, text, cmd);
+				auto owner = _owner();
+				return std::unique_ptr<cursor>(new cursor(std::move(stmt), [reader, owner]() mutable {reader.reset();}, _cursor_profiler(text, started)));
+			}
+			auto lock = _lock_writer();
+			if(false == is_open()) _commit_error("data base is not open");
+			auto started = std::chrono::steady_clock::now();
+			auto stmt = _prepare(m_connection.get(), m_statements, text, cmd);
+			auto mutex = lock.release();
+			auto owner = _owner();
+			return std::unique_ptr<cursor>(new cursor(std::move(stmt), [this, mutex, owner]() {_settle_commit(); mutex->unlock();}, _cursor_profiler(text, started)));
+		}
+#if SQLITE_VERSION_NUMBER >= 3004000
+		//opens column of the row with rowid for incremental reading or writing. reads go to a reader connection when the pool is open.
+		std::unique_ptr<blob_stream> open_blob(const wstring& table, const wstring& column, int64_t rowid, blob_mode mode = blob_read)
+		{
+			if(false == is_open()) _commit_error("data base is not open");
+			auto table_name = codepage::unicode_to_utf8(table);
+			auto column_name = codepage::unicode_to_utf8(column);
+			sqlite3_blob* blob = nullptr;
+			if(blob_read == mode && false == m_readers.empty() && false == _in_transaction())
+			{
+				auto reader = std::make_shared<reader_pool::lease>(m_readers);
+				auto connection = (*reader)->connection.get();
+				if(SQLITE_OK != sqlite3_blob_open(connection, "main", table_name.c_str(), column_name.c_str(), rowid, 0, &blob))
+				{
+					sqlite3_blob_close(blob);
+					_commit_error(connection);
+				}
+				auto owner = _owner();
+				return std::unique_ptr<blob_stream>(new blob_stream(connection, blob, [reader, owner]() mutable {reader.reset();}));
+			}
+			auto lock = _lock_writer();
+			if(false == is_open()) _commit_error("data base is not open");
+			if(SQLITE_OK != sqlite3_blob_open(m_connection.get(), "main", table_name.c_str(), column_name.c_str(), rowid, mode, &blob))
+			{
+				sqlite3_blob_close(blob);
+				_commit_error();
+			}
+			auto mutex = lock.release();
+			auto owner = _owner();
+			return std::unique_ptr<blob_stream>(new blob_stream(m_connection.get(), blob, [this, mutex, owner]() {_settle_commit(); mutex->unlock();}));
+		}
+		std::unique_ptr<blob_stream> open_blob(const string& table, const string& column, int64_t rowid, blob_mode mode = blob_read)
+		{
+			return open_blob(narrow_to_unicode(table), narrow_to_unicode(column), rowid, mode);
+		}
+#endif
+		//hands the cached statement for text to run while holding the connection. run is responsible for stepping and resetting it.
+		void use_statement(const wstring& text, const std::function<void(sqlite3_stmt*)>& run)
+		{
+			auto lock = _lock_writer();
+
+			if(false == is_open()) _commit_error("data base is not open");
+			_use_statement(m_connection.get(), m_statements, codepage::unicode_to_utf8(text), run);
+			_settle_commit();
+		}
+		//the same for utf-8 text, except that a select runs on a reader connection when the pool is open.
+		void use_statement(const string& utf8_text, const std::function<void(sqlite3_stmt*)>& run)
+		{
+			if(false == is_open()) _commit_error("data base is not open");
+			if(_is_reader_statement(utf8_text))
+			{
+				reader_pool::lease reader(m_readers);
+				_use_statement(reader->connection.get(), reader->statements, utf8_text, run);
+				return;
+			}
+			auto lock = _lock_writer();
+			if(false == is_open()) _commit_error("data base is not open");
+			_use_statement(m_connection.get(), m_statements, utf8_text, run);
+			_settle_commit();
+		}
+		//executes text with its parameters bound positionally by bind, skipping the named lookup of command.
+		size_t execute_bound(const wstring& text, const std::function<void(sqlite3_stmt*)>& bind)
+		{
+			DeclareSection(m_connection_mutex);
+
+			use_statement(text, [this, &bind](sqlite3_stmt* stmt)
+			{
+				bind(stmt);
+				int ret = sqlite3_step(stmt);
+				if(SQLITE_DONE != ret && SQLITE_ROW != ret)
+					_commit_error();
+			});
+			return sqlite3_changes(m_connection.get());
+		}
+		std::unique_ptr<transaction> transaction_scope()
+		{
+			return std::unique_ptr<transaction>(new transaction(this));
+		}
+		void get_table_info(const wstring& table_name, table* t)
+		{
+			table dt;
+
+			const_cast<dao*>(this)->execute((boost::wformat(L"select sql from sqlite_master where name = '%1%'") % table_name).str(), &dt, 0, -1);
+
+			t->clear();
+			t->_add_column(L"name");
+			t->_add_column(L"type");
+			t->_add_column(L"length");
+			t->_add_column(L"precision");
+			t->_add_column(L"restriction");
+			if(dt.row_number())
+			{
+				auto text = dt[0][0].to_wstring();
+				std::wregex reg(L"\\[\\w+\\].*");
+				wsregex_iterator itr(text.begin(), text.end(), reg);
+				wsregex_iterator end;
+				std::for_each(itr, end, [](const wsmatch& it)
+				{
+					//it[0] = line text
+					//set table trait record
+					assert(false);
+				});
+			}
+		}
+		void begin_transaction()
+		{
+			m_connection_mutex.lock();
+			_exec("begin transaction;");
+			m_transaction_thread = boost::this_thread::get_id();
+		}
+		void commit_transaction()
+		{
 			_exec("commit transaction;");
+			m_transaction_thread = boost::thread::id();
+			m_connection_mutex.unlock();
+		}
+		void rollback_transaction()
+		{
+			_exec("rollback transaction;");
+			m_transaction_thread = boost::thread::id();
+			m_connection_mutex.unlock();
+		}
+		void abort()
+		{
+			sqlite3_interrupt(m_connection.get());
 			m_connection_mutex.unlock();
 		}
-		void rollback_transaction()
+		void create_table(const wstring& name, const wstring& keys)
+		{
+			execute(L"create table [" + name + L"](" + keys + L")");
+		}
+		void set_statement_cache_size(size_t capacity)
+		{
+			DeclareSection(m_connection_mutex);
+			m_statements.set_capacity(capacity);
+		}
+		statement_cache_statistics statement_cache_stats()
+		{
+			DeclareSection(m_connection_mutex);
+			return m_statements.statistics();
+		}
+		void reset_statement_cache_stats()
+		{
+			DeclareSection(m_connection_mutex);
+			m_statements.reset_statistics();
+		}
+		//keeps up to max_bytes of select results for select_cached. 0 turns the cache off and drops what it holds.
+		void enable_result_cache(size_t max_bytes)
+		{
+			DeclareSection(m_connection_mutex);
+			m_results.set_capacity(max_bytes);
+			//statements prepared before may still use the truncate optimization, which skips the update hook
+			m_statements.clear();
+		}
+		//registers a new consumer of committed row changes. the feed stops receiving events once it is released.
+		std::shared_ptr<change_feed> subscribe_changes(size_t capacity = 65536, bool values = false)
+		{
+			auto feed = std::make_shared<change_feed>(capacity, values);
+			boost::unique_lock<boost::mutex> lock(m_feeds_mutex);
+			m_feeds.push_back(feed);
+			m_capture_changes = true;
+			m_capture_values = m_capture_values || values;
+			lock.unlock();
+			//statements prepared before may still use the truncate optimization, which skips the update hook
+			DeclareSection(m_connection_mutex);
+			m_statements.clear();
+			return feed;
+		}
+		result_cache_stats result_cache_statistics() {return m_results.statistics();}
+		void reset_result_cache_stats() {m_results.reset_statistics();}
+		//runs a select through the result cache. the returned table is shared with other callers and must not be changed.
+		//transactions opened on this thread bypass the cache, since they may see their own uncommitted changes.
+		std::shared_ptr<const table> select_cached(const command& cmd, uint64_t start = 0, uint64_t count = -1)
+		{
+			if(false == m_results.enabled() || _in_transaction())
+			{
+				auto rows = std::make_shared<table>();
+				execute(cmd, rows.get(), start, count);
+				return rows;
+			}
+			auto text = _command_text(cmd, start, count);
+			auto key = _cache_key(text, cmd);
+			uint64_t generation;
+			if(auto rows = m_results.find(key, generation))
+				return rows;
+			vector<string> tables;
+			if(false == m_results.dependencies(text, tables))
+			{
+				tables = _read_tables(text);
+				m_results.set_dependencies(text, tables);
+			}
+			auto rows = std::make_shared<table>();
+			execute(cmd, rows.get(), start, count);
+			m_results.store(key, rows, tables, generation);
+			return rows;
+		}
+		//per-statement timing and vm counters, aggregated by normalized sql text. off by default.
+		void enable_profiling(bool enable = true) {m_profiling = enable;}
+		map<string, statement_profile> statement_profiles() {return m_profiles.snapshot();}
+		void reset_statement_profiles() {m_profiles.reset();}
+		connection_pool_stats pool_stats() {return m_readers.statistics();}
+		void reset_pool_stats() {m_readers.reset_statistics();}
+
+		//takes effect for the next asynchronous call. the workers are started lazily.
+		void set_async_options(const async_options& options)
+		{
+			_stop_executor();
+			boost::unique_lock<boost::mutex> lock(m_async_mutex);
+			m_async_options = options;
+		}
+		//runs work(*this) on the dao's worker threads.
+		template<class Func>
+		auto post(Func work) -> std::future<decltype(work(*(dao*)nullptr))>
+		{
+			typedef decltype(work(*this)) result_type;
+			auto promise = std::make_shared<std::promise<result_type>>();
+			auto future = promise->get_future();
+			auto executor = _executor();
+			bool wait;
+			{
+				boost::unique_lock<boost::mutex> lock(m_async_mutex);
+				wait = m_async_options.block_when_full;
+			}
+			bool accepted = executor->submit([this, promise, work]() {_fulfil(*promise, [this, &work]() {return work(*this);});}, wait);
+			if(false == accepted)
+				promise->set_exception(std::make_exception_ptr(exception2() << error_wtext(L"the asynchronous queue is full")));
+			return future;
+		}
+		//batches of group-committed writes are bounded by these. see submit_write.
+		void set_group_commit_options(const group_commit_options& options)
+		{
+			_stop_group_commit();
+			boost::unique_lock<boost::mutex> lock(m_async_mutex);
+			m_group_commit_options = options;
+		}
+		//queues work for the group commit writer, which runs it with other queued writes in one transaction.
+		//the future completes once that transaction has committed, or carries the error of work or of the commit.
+		//bytes is the payload estimate counted against max_bytes. a failing work is rolled back on its own, so none of
+		//its statements are committed. sqlite before 3.6.8 has no savepoints, and then every work commits by itself.
+		std::future<size_t> submit_write(const std::function<size_t(dao&)>& work, size_t bytes = 0)
+		{
+			return _group_commit()->submit([this, work]() {return work(*this);}, bytes);
+		}
+		group_commit_stats group_commit_statistics()
+		{
+			boost::unique_lock<boost::mutex> lock(m_async_mutex);
+			if(nullptr == m_group_commit)
+			{
+				group_commit_stats stats = {0, 0, 0};
+				return stats;
+			}
+			return m_group_commit->statistics();
+		}
+		std::future<size_t> execute_async(const command& cmd)
+		{
+			return post([cmd](dao& d) {return d.execute(cmd);});
+		}
+		std::future<std::shared_ptr<table>> select_async(const command& cmd, uint64_t start = 0, uint64_t count = -1)
+		{
+			return post([cmd, start, count](dao& d)
+			{
+				auto t = std::make_shared<table>();
+				d.execute(cmd, t.get(), start, count);
+				return t;
+			});
+		}
+	private:
+		size_t _execute(sqlite3* connection, statement_cache& statements, const string& text, const command& cmd, table* table)
+		{
+			try{
+				bool profiling = m_profiling;
+				auto prepare_started = profiling ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+				auto stmt = _prepare(connection, statements, text, cmd, true);
+				auto step_started = profiling ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+				int				column_count;
+				long			i, j;
+				int				ret;
+
+				ret = stmt->step();
+				column_count = sqlite3_column_count(stmt->get());
+
+				if(nullptr != table)
+				{
+					table->clear();
+					for(i = 0; i < column_count; ++i)
+						table->_add_column(codepage::utf8_to_unicode(sqlite3_column_name(stmt->get(), i)));
+				}
+				for(i = 0; SQLITE_ROW == ret; ret = stmt->step())
+				{
+					if(nullptr != table)
+					{
+						table->_add_record();
+						for(j = 0; j < column_count; ++j)
+						{
+							column_value(stmt->get(), j, (*table)[i][j]);
+						}
+					}
+					++i;
+				}
+
+				if(column_count && SQLITE_DONE != ret)
+				{
+					_commit_error(connection);
+				}
+				if(profiling)
+				{
+					auto finished = std::chrono::steady_clock::now();
+					m_profiles.record(text, stmt->get(),
+						std::chrono::duration<double>(step_started - prepare_started).count(),
+						std::chrono::duration<double>(finished - step_started).count(),
+						i, column_count ? 0 : sqlite3_changes(connection));
+				}
+				return sqlite3_changes(connection);
+			}
+			catch(const exception2& e)
+			{
+				throw e;
+			}
+			catch(...)
+			{
+				commit_error(L"unknown error while executing command in sqlite_hsd.");
+			}
+		}
+		void _use_statement(sqlite3* connection, statement_cache& statements, const string& text, const std::function<void(sqlite3_stmt*)>& run)
+		{
+			bool profiling = m_profiling;
+			auto prepare_started = profiling ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+			auto total_changes = sqlite3_total_changes(connection);
+			statement_cache::lease stmt(statements, text, statements.acquire(connection, text));
+			if(!stmt)
+				_commit_error(connection);
+			auto step_started = profiling ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+			run(stmt.get());
+			if(profiling)
+			{
+				m_profiles.record(text, stmt.get(),
+					std::chrono::duration<double>(step_started - prepare_started).count(),
+					std::chrono::duration<double>(std::chrono::steady_clock::now() - step_started).count(),
+					0, sqlite3_total_changes(connection) - total_changes);
+			}
+		}
+		//borrow binds the values of cmd without copying, for statements that are done before cmd goes away.
+		std::unique_ptr<statement_cache::lease> _prepare(sqlite3* connection, statement_cache& statements, const string& text, const command& cmd, bool borrow = false)
+		{
+			std::unique_ptr<statement_cache::lease> stmt(new statement_cache::lease(statements, text, statements.acquire(connection, text)));
+			if(!*stmt)
+				_commit_error(connection);
+			bind_command(stmt->get(), cmd, borrow ? SQLITE_STATIC : SQLITE_TRANSIENT);
+			return stmt;
+		}
+		//the shared_ptr owning this dao, or null for a dao that is not owned by one.
+		std::shared_ptr<dao> _owner()
+		{
+			try
+			{
+				return shared_from_this();
+			}
+			catch(const std::bad_weak_ptr&)
+			{
+				return nullptr;
+			}
+		}
+		boost::unique_lock<boost::recursive_mutex> _lock_writer()
+		{
+			boost::unique_lock<boost::recursive_mutex> lock(m_connection_mutex, boost::try_to_lock);
+			if(lock.owns_lock())
+			{
+				if(false == m_readers.empty()) m_readers.writer_acquired(false, 0);
+				return lock;
+			}
+			auto started = std::chrono::steady_clock::now();
+			lock.lock();
+			if(false == m_readers.empty())
+				m_readers.writer_acquired(true, std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+			return lock;
+		}
+		//reads go to the pool unless the calling thread is inside a transaction and must see its own writes.
+		bool _is_reader_statement(const string& sql)const
+		{
+			if(m_readers.empty() || _in_transaction()) return false;
+			auto pos = sql.find_first_not_of(" \t\r\n");
+			if(string::npos == pos) return false;
+			if(_keyword_at(sql, pos, "select")) return true;
+			if(false == _keyword_at(sql, pos, "with")) return false;
+			//a common table expression can lead an insert, update or delete as well.
+			for(size_t i = pos; i < sql.size(); ++i)
+			{
+				if(i && (isalnum((unsigned char)sql[i - 1]) || '_' == sql[i - 1])) continue;
+				if(_keyword_at(sql, i, "insert") || _keyword_at(sql, i, "update") || _keyword_at(sql, i, "delete") || _keyword_at(sql, i, "replace"))
+					return false;
+			}
+			return true;
+		}
+		static bool _keyword_at(const string& sql, size_t pos, const char* keyword)
+		{
+			size_t size = strlen(keyword);
+			if(sql.size() < pos + size || false == boost::iequals(boost::string_ref(sql).substr(pos, size), keyword)) return false;
+			return sql.size() == pos + size || false == (isalnum((unsigned char)sql[pos + size]) || '_' == sql[pos + size]);
+		}
+		bool _in_transaction()const {return boost::this_thread::get_id() == m_transaction_thread.load();}
+		//runs a pragma and returns the first column of its first row, or an empty string when it returns none.
+		static string _pragma(sqlite3* connection, const string& pragma)
+		{
+			sqlite3_stmt* stmt = nullptr;
+			sqlite3_prepare(connection, ("pragma " + pragma + ";").c_str(), -1, &stmt, nullptr);
+			string result;
+			if(stmt && SQLITE_ROW == sqlite3_step(stmt) && sqlite3_column_text(stmt, 0))
+				result = (const char*)sqlite3_column_text(stmt, 0);
+			sqlite3_finalize(stmt);
+			return result;
+		}
+		std::function<void(sqlite3_stmt*, uint64_t, double)> _cursor_profiler(const string& text, std::chrono::steady_clock::time_point prepare_started)
+		{
+			if(false == m_profiling) return nullptr;
+			double prepare_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - prepare_started).count();
+			auto profiles = &m_profiles;
+			return [profiles, text, prepare_seconds](sqlite3_stmt* stmt, uint64_t rows, double step_seconds)
+			{
+				profiles->record(text, stmt, prepare_seconds, step_seconds, rows, 0);
+			};
+		}
+		std::shared_ptr<task_executor> _executor()
+		{
+			boost::unique_lock<boost::mutex> lock(m_async_mutex);
+			if(nullptr == m_executor)
+			{
+				size_t workers = m_async_options.workers ? m_async_options.workers : (std::max)(m_readers.statistics().readers, (size_t)1);
+				m_executor = task_executor::create(workers, m_async_options.queue_capacity);
+			}
+			return m_executor;
+		}
+		std::shared_ptr<group_commit_queue> _group_commit()
+		{
+			boost::unique_lock<boost::mutex> lock(m_async_mutex);
+			if(nullptr == m_group_commit)
+				m_group_commit = group_commit_queue::create(m_group_commit_options, [this](vector<group_commit_queue::write>& batch) {_commit_group(batch);});
+			return m_group_commit;
+		}
+		void _stop_group_commit()
+		{
+			std::shared_ptr<group_commit_queue> queue;
+			{
+				boost::unique_lock<boost::mutex> lock(m_async_mutex);
+				queue.swap(m_group_commit);
+			}
+			if(queue) queue->stop();
+		}
+		//runs a batch in one transaction, undoing a failing write on its own through a savepoint so the rest still commit.
+		//before 3.6.8 there are no savepoints, so each write then commits in its own transaction instead.
+		void _commit_group(vector<group_commit_queue::write>& batch)
+		{
+			bool savepoints = sqlite3_libversion_number() >= 3006008;
+			if(false == savepoints && batch.size() > 1)
+			{
+				BOOST_FOREACH(auto& it, batch)
+				{
+					vector<group_commit_queue::write> single(1, it);
+					_commit_group(single);
+				}
+				return;
+			}
+			vector<size_t> results(batch.size());
+			vector<std::exception_ptr> errors(batch.size());
+			try
+			{
+				begin_transaction();
+			}
+			catch(...)
+			{
+				m_connection_mutex.unlock();
+				BOOST_FOREACH(auto& it, batch)
+					it.promise->set_exception(std::current_exception());
+				return;
+			}
+			for(size_t i = 0; i < batch.size(); ++i)
+			{
+				try
+				{
+					if(savepoints) _exec("savepoint group_write;");
+					results[i] = batch[i].work();
+					if(savepoints) _exec("release group_write;");
+				}
+				catch(...)
+				{
+					errors[i] = std::current_exception();
+					if(savepoints) sqlite3_exec(m_connection.get(), "rollback to group_write; release group_write;", 0, 0, nullptr);
+				}
+			}
+			try
+			{
+				//a lone write without a savepoint is undone with its transaction
+				if(false == savepoints && errors[0]) std::rethrow_exception(errors[0]);
+				commit_transaction();
+			}
+			catch(...)
+			{
+				auto error = std::current_exception();
+				sqlite3_exec(m_connection.get(), "rollback transaction;", 0, 0, nullptr);
+				m_transaction_thread = boost::thread::id();
+				m_connection_mutex.unlock();
+				BOOST_FOREACH(auto& it, batch)
+					it.promise->set_exception(error);
+				return;
+			}
+			for(size_t i = 0; i < batch.size(); ++i)
+			{
+				if(errors[i]) batch[i].promise->set_exception(errors[i]);
+				else batch[i].promise->set_value(results[i]);
+			}
+		}
+		void _stop_executor()
+		{
+			std::shared_ptr<task_executor> executor;
+			{
+				boost::unique_lock<boost::mutex> lock(m_async_mutex);
+				executor.swap(m_executor);
+			}
+			if(executor) executor->stop();
+		}
+		template<class Result, class Func>
+		static void _fulfil(std::promise<Result>& promise, Func func)
+		{
+			try {promise.set_value(func());}
+			catch(...) {promise.set_exception(std::current_exception());}
+		}
+		template<class Func>
+		static void _fulfil(std::promise<void>& promise, Func func)
+		{
+			try {func(); promise.set_value();}
+			catch(...) {promise.set_exception(std::current_exception());}
+		}
+		void _schema_changed()
+		{
+			m_statements.clear();
+			m_readers.schema_changed();
+			m_results.clear();
+		}
+		void _install_hooks()
+		{
+			if(nullptr == m_connection) return;
+			sqlite3_update_hook(m_connection.get(), &dao::_on_update, this);
+			sqlite3_commit_hook(m_connection.get(), &dao::_on_commit, this);
+			sqlite3_rollback_hook(m_connection.get(), &dao::_on_rollback, this);
+			sqlite3_set_authorizer(m_connection.get(), &dao::_on_authorize, this);
+#if defined(SQLITE_ENABLE_PREUPDATE_HOOK) && SQLITE_VERSION_NUMBER >= 3013000
+			sqlite3_preupdate_hook(m_connection.get(), &dao::_on_preupdate, this);
+#endif
+		}
+		static void _on_update(void* self, int op, const char*, const char* table, sqlite_int64 rowid)
+		{
+			auto d = (dao*)self;
+			if(d->m_results.enabled()) d->m_results.changed(table);
+			if(d->m_capture_changes)
+			{
+				change_event e = {0, op, table, rowid, vector<value_t>()};
+				if(d->m_capture_values && d->m_has_preupdate && d->m_preupdate_rowid == rowid)
+					e.values = std::move(d->m_preupdate_values);
+				d->m_has_preupdate = false;
+				d->m_pending_changes.push_back(std::move(e));
+			}
+		}
+#if defined(SQLITE_ENABLE_PREUPDATE_HOOK) && SQLITE_VERSION_NUMBER >= 3013000
+		//runs just before the update hook of the same row, which picks the values up.
+		static void _on_preupdate(void* self, sqlite3* connection, int op, const char*, const char*, sqlite3_int64 old_rowid, sqlite3_int64 new_rowid)
+		{
+			auto d = (dao*)self;
+			if(false == d->m_capture_changes || false == d->m_capture_values) return;
+			d->m_preupdate_values.clear();
+			for(int i = 0; i < sqlite3_preupdate_count(connection); ++i)
+			{
+				sqlite3_value* v = nullptr;
+				if(SQLITE_DELETE == op) sqlite3_preupdate_old(connection, i, &v);
+				else sqlite3_preupdate_new(connection, i, &v);
+				d->m_preupdate_values.push_back(v ? sqlite_value(v) : value_t());
+			}
+			d->m_preupdate_rowid = SQLITE_DELETE == op ? old_rowid : new_rowid;
+			d->m_has_preupdate = true;
+		}
+#endif
+		//the commit may still fail, e.g. with SQLITE_BUSY, so its effects are only applied by _settle_commit. the
+		//pending changes stay queued until then.
+		static int _on_commit(void* self)
+		{
+			auto d = (dao*)self;
+			d->m_commit_staged = true;
+			return 0;
+		}
+		static void _on_rollback(void* self)
+		{
+			auto d = (dao*)self;
+			d->m_commit_staged = false;
+			d->m_results.rolled_back();
+			d->m_pending_changes.clear();
+			d->m_has_preupdate = false;
+		}
+		//called with the writer held after it ran something. a staged commit has succeeded once the connection is back
+		//in autocommit mode, since a failed one either leaves the transaction open or rolls it back.
+		void _settle_commit()
+		{
+			if(false == m_commit_staged || nullptr == m_connection || 0 == sqlite3_get_autocommit(m_connection.get())) return;
+			m_commit_staged = false;
+			m_results.committed();
+			if(m_pending_changes.size())
+				_publish_changes();
+		}
+		void _publish_changes()
+		{
+			boost::unique_lock<boost::mutex> lock(m_feeds_mutex);
+			BOOST_FOREACH(auto& it, m_pending_changes)
+			{
+				it.sequence = ++m_change_sequence;
+				BOOST_FOREACH(auto& feed, m_feeds)
+					if(auto f = feed.lock()) f->_push(it);
+			}
+			m_pending_changes.clear();
+			m_feeds.erase(std::remove_if(m_feeds.begin(), m_feeds.end(), [](const std::weak_ptr<change_feed>& f) {return f.expired();}), m_feeds.end());
+			if(m_feeds.empty()) m_capture_changes = m_capture_values = false;
+		}
+		static int _on_authorize(void* self, int action, const char* first, const char*, const char*, const char*)
+		{
+			auto d = (dao*)self;
+			if(SQLITE_READ == action && d->m_read_tables && first)
+			{
+				auto name = boost::to_lower_copy(string(first));
+				if(d->m_read_tables->end() == std::find(d->m_read_tables->begin(), d->m_read_tables->end(), name))
+					d->m_read_tables->push_back(name);
+			}
+			//a drop checks a delete on the schema table and on the dropped table right after its drop action, and
+			//SQLITE_IGNORE would cancel it. for a delete statement it only turns off the truncate optimization, which
+			//would bypass the update hook.
+			if(_is_drop_table(action) && first)
+				d->m_dropping = first;
+			else if(SQLITE_DELETE == action && first)
+			{
+				bool dropping = boost::iequals(d->m_dropping, first);
+				d->m_dropping.clear();
+				if((d->m_results.enabled() || d->m_capture_changes) && false == dropping && false == _is_schema_table(first))
+					return SQLITE_IGNORE;
+			}
+			return SQLITE_OK;
+		}
+		static bool _is_drop_table(int action)
+		{
+#ifdef SQLITE_DROP_VTABLE
+			if(SQLITE_DROP_VTABLE == action) return true;
+#endif
+			return SQLITE_DROP_TABLE == action || SQLITE_DROP_TEMP_TABLE == action || SQLITE_DROP_VIEW == action || SQLITE_DROP_TEMP_VIEW == action;
+		}
+		static bool _is_schema_table(const char* table)
+		{
+			if(nullptr == table) return false;
+			return boost::iequals(table, "sqlite_master") || boost::iequals(table, "sqlite_temp_master") ||
+				boost::iequals(table, "sqlite_schema") || boost::iequals(table, "sqlite_temp_schema");
+		}
+		//the tables text reads from, as reported to the authorizer while preparing it.
+		vector<string> _read_tables(const string& text)
+		{
+			auto lock = _lock_writer();
+			if(false == is_open()) _commit_error("data base is not open");
+			vector<string> tables;
+			m_read_tables = &tables;
+			sqlite3_stmt* stmt = nullptr;
+			sqlite3_prepare(m_connection.get(), text.c_str(), -1, &stmt, nullptr);
+			m_read_tables = nullptr;
+			if(nullptr == stmt) _commit_error();
+			sqlite3_finalize(stmt);
+			return tables;
+		}
+		static string _cache_key(const string& text, const command& cmd)
+		{
+			string key = text;
+			auto append = [&key](const value_t& v)
+			{
+				auto& value = (const __value_t&)v;
+				key += (char)value.which();
+				switch(value.which())
+				{
+				case value_t::integer_value:
+					key.append((const char*)&boost::get<int64_t>(value), sizeof(int64_t));
+					break;
+				case value_t::real_value:
+					key.append((const char*)&boost::get<double>(value), sizeof(double));
+					break;
+				case value_t::text_value:
+					{
+						auto& text = boost::get<text_t>(value);
+						key += boost::lexical_cast<string>(text.size()) + ':';
+						key.append((const char*)text.data(), text.size() * sizeof(text_t::value_type));
+					}
+					break;
+				case value_t::blob_value:
+					{
+						auto& blob = boost::get<vector<char>>(value);
+						key += boost::lexical_cast<string>(blob.size()) + ':';
+						key.append(blob.begin(), blob.end());
+					}
+					break;
+				}
+			};
+			BOOST_FOREACH(auto& it, cmd.named_parameters())
+			{
+				key += '\0' + codepage::unicode_to_utf8(it.first) + '=';
+				append(it.second);
+			}
+			BOOST_FOREACH(auto& it, cmd.indexed_parameters())
+			{
+				key += '\0';
+				append(it);
+			}
+			BOOST_FOREACH(auto& it, cmd.unnamed_parameters())
+			{
+				key += '\1';
+				append(it);
+			}
+			BOOST_FOREACH(auto& it, cmd.borrowed_parameters())
+			{
+				key += '\0' + boost::lexical_cast<string>(it.index) + ':' + boost::lexical_cast<string>(it.size) + ':';
+				key.append((const char*)it.data, it.size);
+			}
+			return key;
+		}
+		static string _command_text(const command& cmd, uint64_t start, uint64_t count)
+		{
+			return codepage::unicode_to_utf8(cmd.get_cmd_text()) + limit_clause(start, count);
+		}
+		static bool _is_schema_change(const string& sql)
+		{
+			auto pos = sql.find_first_not_of(" \t\r\n");
+			if(string::npos == pos) return false;
+			auto verb = boost::to_lower_copy(sql.substr(pos, 6));
+			return boost::starts_with(verb, "create") || boost::starts_with(verb, "drop") || boost::starts_with(verb, "alter");
+		}
+
+		inline void _exec(const string& sql)
+		{
+			char*	error = nullptr;
+			if(SQLITE_OK != sqlite3_exec(m_connection.get(), sql.c_str(), 0, 0, &error))
+				_commit_error(error);
+			_settle_commit();
+			if(_is_schema_change(sql))
+				_schema_changed();
+		}
+		inline void _commit_error(const string& error)
+		{
+			commit_error(codepage::acp_to_unicode(error));
+		}
+		inline void _commit_error()
+		{
+			_commit_error(m_connection.get());
+		}
+		inline void _commit_error(sqlite3* connection)
+		{
+			auto text = sqlite3_errmsg(connection);
+			_commit_error(text);
+		}
+	private:
+		std::shared_ptr<sqlite3> m_connection;
+		statement_cache m_statements;
+		boost::recursive_mutex m_connection_mutex;
+		int m_busy_timeout;
+		//written under m_connection_mutex, read by any thread to tell whether it is the one inside the transaction.
+		std::atomic<boost::thread::id> m_transaction_thread;
+		reader_pool m_readers;
+		boost::filesystem::path m_datasource;
+		result_cache m_results;
+		//set by the commit hook, cleared once the commit is known to have succeeded or was rolled back.
+		bool m_commit_staged;
+		boost::mutex m_feeds_mutex;
+		vector<std::weak_ptr<change_feed>> m_feeds;
+		std::atomic<bool> m_capture_changes;
+		std::atomic<bool> m_capture_values;
+		vector<change_event> m_pending_changes;
+		vector<value_t> m_preupdate_values;
+		int64_t m_preupdate_rowid;
+		bool m_has_preupdate;
+		uint64_t m_change_sequence;
+		vector<string>* m_read_tables;
+		//the table or view a drop being prepared is about to check a delete on
+		string m_dropping;
+		std::atomic<bool> m_profiling;
+		statement_registry m_profiles;
+		boost::mutex m_async_mutex;
+		async_options m_async_options;
+		std::shared_ptr<task_executor> m_executor;
+		group_commit_options m_group_commit_options;
+		std::shared_ptr<group_commit_queue> m_group_commit;
+	};
+	struct bulk_insert_stats
+	{
+		uint64_t	rows;
+		double		seconds;
+
+		double rows_per_second()const {return seconds > 0 ? rows / seconds : 0;}
+	};
+	struct import_progress
+	{
+		uint64_t	rows;
+		uint64_t	bytes;
+		uint64_t	total_bytes;
+		double		seconds;
+	};
+	struct import_options
+	{
+		char				delimiter;
+		char				quote;			//0 turns quoting off, as usual for tsv
+		bool				header;			//the first line names the columns
+		bool				empty_as_null;
+		vector<wstring>		columns;		//target column of each field in order, an empty name skips the field. defaults to the header
+		size_t				chunk_size;		//rows per transaction
+		size_t				buffer_size;
+		uint64_t			progress_rows;	//rows between two progress calls, 0 calls it only at the end
+		std::function<bool(const import_progress&)>	progress;	//returning false stops the import after the rows read so far
+
+		import_options(char delimiter = ',', char quote = '"') : delimiter(delimiter), quote(quote), header(true), empty_as_null(true),
+			chunk_size(100000), buffer_size(1 << 20), progress_rows(100000) {}
+	};
+	//splits a utf-8 delimited file into records through one reusable buffer. fields point into the buffer and stay valid
+	//until the next call to next(). quoted fields are unescaped in place.
+	class delimited_reader : boost::noncopyable
+	{
+	private:
+		boost::filesystem::ifstream				m_file;
+		vector<char>							m_buffer;
+		size_t									m_begin;
+		size_t									m_end;
+		bool									m_eof;
+		uint64_t								m_bytes;
+		char									m_delimiter;
+		char									m_quote;
+		vector<boost::string_ref>				m_fields;
+
+	public:
+		delimited_reader(const boost::filesystem::path& source, char delimiter, char quote, size_t buffer_size = 1 << 20)
+			: m_file(source, std::ios::binary), m_buffer((std::max)(buffer_size, (size_t)4096)), m_begin(0), m_end(0), m_eof(false), m_bytes(0),
+			m_delimiter(delimiter), m_quote(quote)
+		{
+			if(false == m_file.is_open())
+				commit_error(L"cannot open " + source.wstring());
+			_fill();
+			if(m_end >= 3 && 0 == memcmp(&m_buffer[0], "\xef\xbb\xbf", 3))
+				m_begin = 3;
+		}
+		uint64_t bytes_read()const {return m_bytes;}
+		size_t size()const {return m_fields.size();}
+		const boost::string_ref& operator [](size_t field)const {return m_fields[field];}
+		bool next()
+		{
+			for(;;)
+			{
+				size_t end = _record_end();
+				if(string::npos == end)
+				{
+					if(false == m_eof)
+					{
+						_fill();
+						continue;
+					}
+					if(m_begin == m_end) return false;
+					end = m_end;
+				}
+				size_t next = end < m_end ? end + 1 : end;
+				if(end > m_begin && '\r' == m_buffer[end - 1]) --end;
+				if(end == m_begin)
+				{
+					m_begin = next;
+					continue;
+				}
+				_split(m_begin, end);
+				m_begin = next;
+				return true;
+			}
+		}
+
+	private:
+		//keeps the unread tail, grows the buffer when one record does not fit and reads as much as there is room for.
+		void _fill()
 		{
-			_exec("rollback transaction;");
-			m_connection_mutex.unlock();
+			if(m_begin)
+			{
+				memmove(&m_buffer[0], &m_buffer[m_begin], m_end - m_begin);
+				m_end -= m_begin;
+				m_begin = 0;
+			}
+			if(m_end == m_buffer.size())
+				m_buffer.resize(m_buffer.size() * 2);
+			m_file.read(&m_buffer[m_end], m_buffer.size() - m_end);
+			size_t read = (size_t)m_file.gcount();
+			m_end += read;
+			m_bytes += read;
+			if(0 == read) m_eof = true;
 		}
-		void abort()
+		size_t _record_end()const
 		{
-			sqlite3_interrupt(m_connection.get());
-			m_connection_mutex.unlock();
+			const char* first = &m_buffer[0] + m_begin;
+			const char* last = &m_buffer[0] + m_end;
+			auto newline = (const char*)memchr(first, '\n', last - first);
+			if(0 == m_quote || nullptr == memchr(first, m_quote, (newline ? newline : last) - first))
+				return newline ? newline - &m_buffer[0] : string::npos;
+			//as in _split, only a quote that starts a field opens a quoted field, and a doubled quote inside one stands
+			//for a quote. a quote elsewhere is a plain character.
+			bool field_start = true;
+			for(auto p = first; p != last; ++p)
+			{
+				if(field_start && m_quote == *p)
+				{
+					for(++p; ; ++p)
+					{
+						if(p == last || (p + 1 == last && m_quote == *p && false == m_eof)) return string::npos;
+						if(m_quote != *p) continue;
+						if(p + 1 == last || m_quote != p[1]) break;
+						++p;
+					}
+					field_start = false;
+					continue;
+				}
+				if('\n' == *p) return p - &m_buffer[0];
+				field_start = m_delimiter == *p;
+			}
+			return string::npos;
 		}
-		void create_table(const wstring& name, const wstring& keys)
+		void _split(size_t begin, size_t end)
 		{
-			execute(L"create table [" + name + L"](" + keys + L")");
+			m_fields.clear();
+			char* p = &m_buffer[0] + begin;
+			char* last = &m_buffer[0] + end;
+			for(;;)
+			{
+				char* delimiter;
+				if(m_quote && p != last && m_quote == *p)
+				{
+					char* field = ++p;
+					char* out = field;
+					for(; p != last; ++p)
+					{
+						if(m_quote == *p)
+						{
+							if(p + 1 == last || m_quote != p[1])
+							{
+								++p;
+								break;
+							}
+							++p;
+						}
+						*out++ = *p;
+					}
+					m_fields.push_back(boost::string_ref(field, out - field));
+					delimiter = (char*)memchr(p, m_delimiter, last - p);
+				}
+				else
+				{
+					delimiter = (char*)memchr(p, m_delimiter, last - p);
+					m_fields.push_back(boost::string_ref(p, (delimiter ? delimiter : last) - p));
+				}
+				if(nullptr == delimiter) return;
+				p = delimiter + 1;
+			}
 		}
+	};
+	//continuation of a keyset scan. a default constructed token starts from the first row.
+	struct page_token
+	{
+		value_t		last_key;
+		bool		started;
+		bool		finished;
+
+		page_token() : started(false), finished(false) {}
+	};
+	//a where condition rendered with ? placeholders and the values to bind to them in order, so conditions of the same
+	//shape share one sql text, and one cached statement, whatever the values. built from col(), e.g.
+	//col("age") > 20 && col("name") == name.
+	class predicate
+	{
 	private:
+		wstring				m_sql;
+		vector<value_t>		m_values;
 
-		inline void _exec(const string& sql)
+	public:
+		predicate(const wstring& sql, const vector<value_t>& values) : m_sql(sql), m_values(values) {}
+		const wstring& sql()const {return m_sql;}
+		const vector<value_t>& values()const {return m_values;}
+
+		predicate operator &&(const predicate& other)const {return _join(L" and ", other);}
+		predicate operator ||(const predicate& other)const {return _join(L" or ", other);}
+		predicate operator !()const {return predicate(L"not (" + m_sql + L")", m_values);}
+
+	private:
+		predicate _join(const wchar_t* op, const predicate& other)const
 		{
-			char*	error = nullptr;
-			if(SQLITE_OK != sqlite3_exec(m_connection.get(), sql.c_str(), 0, 0, &error))
-				_commit_error(error);
+			auto values = m_values;
+			values.insert(values.end(), other.m_values.begin(), other.m_values.end());
+			return predicate(L"(" + m_sql + L")" + op + L"(" + other.m_sql + L")", values);
 		}
-		inline void _commit_error(const string& error)
+	};
+	class column_ref
+	{
+	private:
+		wstring		m_name;
+
+	public:
+		explicit column_ref(const wstring& name) : m_name(name) {}
+		predicate operator ==(const value_t& v)const {return _compare(L" = ?", v);}
+		predicate operator !=(const value_t& v)const {return _compare(L" <> ?", v);}
+		predicate operator <(const value_t& v)const {return _compare(L" < ?", v);}
+		predicate operator <=(const value_t& v)const {return _compare(L" <= ?", v);}
+		predicate operator >(const value_t& v)const {return _compare(L" > ?", v);}
+		predicate operator >=(const value_t& v)const {return _compare(L" >= ?", v);}
+		predicate like(const value_t& pattern)const {return _compare(L" like ?", pattern);}
+		predicate between(const value_t& low, const value_t& high)const
 		{
-			commit_error(codepage::acp_to_unicode(error));
+			vector<value_t> values;
+			values.push_back(low);
+			values.push_back(high);
+			return predicate(m_name + L" between ? and ?", values);
 		}
-		inline void _commit_error()
+		predicate in(const vector<value_t>& values)const
 		{
-			auto text = sqlite3_errmsg(m_connection.get());
-			_commit_error(text);
+			if(values.empty()) return predicate(L"0", values);
+			wstring sql = m_name + L" in (?";
+			for(size_t i = 1; i < values.size(); ++i)
+				sql += L",?";
+			return predicate(sql + L")", values);
 		}
+		predicate is_null()const {return predicate(m_name + L" is null", vector<value_t>());}
+		predicate is_not_null()const {return predicate(m_name + L" is not null", vector<value_t>());}
+
 	private:
-		std::shared_ptr<sqlite3> m_connection;
-		boost::recursive_mutex m_connection_mutex;
-		boost::filesystem::path m_datasource;
+		predicate _compare(const wchar_t* op, const value_t& v)const {return predicate(m_name + op, vector<value_t>(1, v));}
+	};
+	inline column_ref col(const wstring& name) {return column_ref(name);}
+	inline column_ref col(const string& name) {return column_ref(narrow_to_unicode(name));}
+	//a select compiled from a table_adapter chain. the sql is rendered once and the parameters are resolved to indexes
+	//once, so a call only binds, steps and fills. the statement itself stays in the statement cache of each connection
+	//that runs it, as a compiled query can run on any connection of the reader pool.
+	class compiled_query
+	{
+	private:
+		std::shared_ptr<dao>		m_database;
+		string						m_text;
+		vector<pair<int, value_t>>	m_fixed;
+		vector<int>					m_slots;
+		vector<wstring>				m_columns;
+
+	public:
+		//unnamed_values are bound to the nameless parameters of text in order, and every other parameter, named or not,
+		//takes a call argument in the order it appears.
+		compiled_query(std::shared_ptr<dao> database, const wstring& text, const vector<value_t>& unnamed_values)
+			: m_database(database), m_text(codepage::unicode_to_utf8(text))
+		{
+			m_database->use_statement(m_text, [&](sqlite3_stmt* stmt)
+			{
+				size_t next = 0;
+				for(int index = 1; index <= sqlite3_bind_parameter_count(stmt); ++index)
+				{
+					if(nullptr == sqlite3_bind_parameter_name(stmt, index) && next < unnamed_values.size())
+						m_fixed.push_back(make_pair(index, unnamed_values[next++]));
+					else
+						m_slots.push_back(index);
+				}
+				for(int i = 0; i < sqlite3_column_count(stmt); ++i)
+					m_columns.push_back(boost::to_lower_copy(codepage::utf8_to_unicode(sqlite3_column_name(stmt, i))));
+			});
+		}
+		const string& sql()const {return m_text;}
+		size_t parameter_count()const {return m_slots.size();}
+
+		//binds params to the open parameters in order and fills t with the result.
+		template<typename... Params>
+		size_t fill(sqlite_hsd::table& t, const Params&... params)const
+		{
+			if(sizeof...(Params) != m_slots.size())
+				commit_error((boost::wformat(L"the query takes %1% parameters, %2% given") % m_slots.size() % sizeof...(Params)).str());
+			if(t.m_column_list == m_columns) t.clear(false);
+			else
+			{
+				t.clear();
+				BOOST_FOREACH(auto& it, m_columns)
+					t._add_column(it);
+			}
+			m_database->use_statement(m_text, [&](sqlite3_stmt* stmt)
+			{
+				BOOST_FOREACH(auto& it, m_fixed)
+					bind_value(stmt, it.first, it.second, SQLITE_STATIC);
+				auto slot = m_slots.begin();
+				int expand[] = {0, (bind_argument(stmt, *slot++, params), 0)...};
+				(void)expand;
+				(void)slot;
+
+				int column_count = (int)m_columns.size();
+				int ret;
+				for(long i = 0; SQLITE_ROW == (ret = sqlite3_step(stmt)); ++i)
+				{
+					t._add_record();
+					for(int j = 0; j < column_count; ++j)
+						column_value(stmt, j, t[i][j]);
+				}
+				if(SQLITE_DONE != ret)
+					commit_error(codepage::acp_to_unicode(sqlite3_errmsg(sqlite3_db_handle(stmt))));
+			});
+			return t.row_number();
+		}
+		template<typename... Params>
+		std::shared_ptr<sqlite_hsd::table> operator()(const Params&... params)const
+		{
+			auto t = std::make_shared<sqlite_hsd::table>();
+			fill(*t, params...);
+			return t;
+		}
+
+	private:
+		//arguments other than value_t are bound as their column_traits, so narrow strings are taken as utf-8.
+		template<class Type>
+		static void bind_argument(sqlite3_stmt* stmt, int index, const Type& v) {column_traits<Type>::bind(stmt, index, v);}
+		static void bind_argument(sqlite3_stmt* stmt, int index, const value_t& v) {bind_value(stmt, index, v, SQLITE_STATIC);}
+		static void bind_argument(sqlite3_stmt* stmt, int index, const char* v) {sqlite3_bind_text(stmt, index, v, -1, SQLITE_STATIC);}
+		static void bind_argument(sqlite3_stmt* stmt, int index, const wchar_t* v) {column_traits<wstring>::bind(stmt, index, v);}
 	};
 	class table_adapter
 	{
@@ -564,15 +3871,17 @@ namespace sqlite_hsd
 		uint64_t start;
 		uint64_t count;
 		wstring where_clause;
+		vector<value_t> where_values;
+		vector<wstring> conflict_columns;
 
 	public:
-		table_adapter(std::shared_ptr<dao> _d, const wstring& t) : table(t), start(0), count(-1), database(_d) {}
-		table_adapter(std::shared_ptr<dao> _d, const string& t) : table(codepage::acp_to_unicode(t)), start(0), count(-1), database(_d) {}
+		table_adapter(std::shared_ptr<dao> _d, const wstring& t) : database(_d), table(t), start(0), count(-1) {}
+		table_adapter(std::shared_ptr<dao> _d, const string& t) : database(_d), table(narrow_to_unicode(t)), start(0), count(-1) {}
 		template<typename CharType>
 		table_adapter(const basic_string<CharType>& t, const boost::filesystem::path& source, const basic_string<CharType>& password = basic_string<CharType>())
-			: table(codepage::_to_unicode<CP_ACP>(t)), start(0), count(-1), database(std::make_shared<dao>())
+			: database(std::make_shared<dao>()), table(codepage::_to_unicode<SQLITE_HSD_CODEPAGE>(t)), start(0), count(-1)
 		{
-			database->open(source, codepage::_to_unicode<CP_ACP>(password));
+			database->open(source, codepage::_to_unicode<SQLITE_HSD_CODEPAGE>(password));
 			if(false == database->is_open())
 				commit_error(L"cannot open the database.");
 		}
@@ -582,7 +3891,7 @@ namespace sqlite_hsd
 			other.columns.push_back(column);
 			return other;
 		}
-		table_adapter operator ()(const string& column)const {return operator()(codepage::acp_to_unicode(column));}
+		table_adapter operator ()(const string& column)const {return operator()(narrow_to_unicode(column));}
 		table_adapter operator [](const wstring& clause)const
 		{
 			auto other = *this;
@@ -592,7 +3901,25 @@ namespace sqlite_hsd
 				other.where_clause += L" and " + clause;
 			return other;
 		}
-		table_adapter operator [](const string& clause)const {return operator[](codepage::acp_to_unicode(clause));}
+		table_adapter operator [](const string& clause)const {return operator[](narrow_to_unicode(clause));}
+		table_adapter operator [](const predicate& condition)const
+		{
+			auto other = (*this)[L"(" + condition.sql() + L")"];
+			other.where_values.insert(other.where_values.end(), condition.values().begin(), condition.values().end());
+			return other;
+		}
+		//declares the unique key columns (comma separated) that make |=, += of records and insert_many upsert in one statement,
+		//or, before sqlite 3.24, in an update and an insert sharing one transaction.
+		table_adapter on_conflict(const wstring& keys)const
+		{
+			auto other = *this;
+			other.conflict_columns.clear();
+			boost::split(other.conflict_columns, keys, boost::is_any_of(L","));
+			BOOST_FOREACH(auto& it, other.conflict_columns)
+				boost::trim(it);
+			return other;
+		}
+		table_adapter on_conflict(const string& keys)const {return on_conflict(narrow_to_unicode(keys));}
 		table_adapter operator ()(uint64_t start, uint64_t count)const
 		{
 			auto other = *this;
@@ -612,10 +3939,16 @@ namespace sqlite_hsd
 			execute_delete(values);
 			return *this;
 		}
+		const table_adapter& operator -= (const predicate& condition)const
+		{
+			(*this)[condition].execute_delete(Values);
+			return *this;
+		}
 		template<typename ValueType>
 		const table_adapter& operator |= (const custom::value_map_t<ValueType>& values)const
 		{
-			execute_update(values, true);
+			if(conflict_columns.size()) execute_upsert(values);
+			else execute_update(values, true);
 			return *this;
 		}
 		template<typename ValueType>
@@ -636,10 +3969,232 @@ namespace sqlite_hsd
 		}
 		const table_adapter& operator >> (sqlite_hsd::table& t)const
 		{
-			wstring sql = (boost::wformat(L"select %1% from [%2%] %3%") % select_columns() % table % where_clause).str();
-			database->execute(sql, &t, start, count);
+			database->execute(select_command(), &t, start, count);
+			return *this;
+		}
+		//takes a shared snapshot through the dao's result cache, when enabled.
+		const table_adapter& operator >> (std::shared_ptr<const sqlite_hsd::table>& t)const
+		{
+			t = database->select_cached(select_command(), start, count);
+			return *this;
+		}
+		const table_adapter& operator >> (columnar_table& t)const
+		{
+			database->execute(select_command(), t, start, count);
+			return *this;
+		}
+		//streams the selected rows into callback without materializing them. returning false from callback stops the scan.
+		const table_adapter& operator >> (const std::function<bool(const cursor::row&)>& callback)const
+		{
+			auto c = query();
+			for(auto itr = c->begin(); c->end() != itr; ++itr)
+				if(false == callback(*itr)) break;
+			return *this;
+		}
+		template<class Record>
+		typename enable_if<is_mapped_record<Record>::value, const table_adapter&>::type operator >> (vector<Record>& rows)const
+		{
+			auto c = database->query(where_command((boost::wformat(L"select %1% from [%2%] %3%") % record_mapper<Record>::column_list() % table % where_clause).str()), start, count);
+			rows.clear();
+			while(c->next())
+			{
+				rows.push_back(Record());
+				c->current().read(rows.back());
+			}
+			return *this;
+		}
+		template<class Record>
+		typename enable_if<is_mapped_record<Record>::value, const table_adapter&>::type operator += (const Record& r)const
+		{
+			insert(r);
 			return *this;
 		}
+		template<class Record>
+		typename enable_if<is_mapped_record<Record>::value>::type insert(const Record& r)const
+		{
+			auto keys = insert_columns(r);
+			insert_row(keys, [&](sqlite3_stmt* stmt) {record_mapper<Record>::bind(stmt, r);});
+		}
+		//inserts every element of rows (value maps or mapped records) through one prepared statement,
+		//committing every chunk_size rows. joins the caller's transaction if one is open.
+		//value maps must all name the same columns, otherwise nothing is inserted and an error is thrown.
+		template<class Range>
+		bulk_insert_stats insert_many(const Range& rows, size_t chunk_size = 10000)const
+		{
+			bulk_insert_stats stats = {0, 0};
+			auto started = std::chrono::steady_clock::now();
+			auto first = std::begin(rows);
+			if(std::end(rows) == first) return stats;
+
+			auto keys = insert_columns(*first);
+			for(auto itr = first; std::end(rows) != itr; ++itr)
+				check_columns(*itr, keys);
+			auto itr = first, row = first;
+			bulk_insert(insert_statements(keys), chunk_size, stats, [&]()
+			{
+				if(std::end(rows) == itr) return false;
+				row = itr++;
+				return true;
+			}, [&](sqlite3_stmt* stmt)
+			{
+				bind_row(stmt, *row, keys);
+				bind_where(stmt, keys.size());
+			});
+			stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+			return stats;
+		}
+		//streams a delimited utf-8 file (csv by default, import_options('\t', 0) for tsv) into the table through one
+		//prepared statement. fields are bound straight from the read buffer and converted by the column affinity.
+		bulk_insert_stats import_delimited(const boost::filesystem::path& source, const import_options& options = import_options())const
+		{
+			bulk_insert_stats stats = {0, 0};
+			auto started = std::chrono::steady_clock::now();
+			delimited_reader reader(source, options.delimiter, options.quote, options.buffer_size);
+			uint64_t total_bytes = boost::filesystem::file_size(source);
+			auto report = [&]()
+			{
+				import_progress progress = {stats.rows, reader.bytes_read(), total_bytes,
+					std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count()};
+				return options.progress(progress);
+			};
+
+			auto targets = options.columns;
+			if(options.header && reader.next() && targets.empty())
+				for(size_t i = 0; i < reader.size(); ++i)
+					targets.push_back(codepage::utf8_to_unicode(boost::trim_copy(reader[i].to_string())));
+			//parameter index of every field, 0 when the field is skipped
+			vector<wstring> keys;
+			vector<int> parameters;
+			BOOST_FOREACH(auto& it, targets)
+			{
+				bool skip = it.empty() || (0 != columns.size() && false == name_in_columns(it));
+				if(false == skip) keys.push_back(it);
+				parameters.push_back(skip ? 0 : (int)keys.size());
+			}
+			if(keys.empty())
+				commit_error(L"no column to import into from " + source.wstring());
+
+			//the fields stay bound into the read buffer until the row has been stepped, so the reader only moves on,
+			//and may refill the buffer, when the next row is asked for.
+			bulk_insert(insert_statements(keys), options.chunk_size, stats, [&]()
+			{
+				if(false == reader.next()) return false;
+				return false == (options.progress && options.progress_rows && stats.rows && 0 == stats.rows % options.progress_rows && false == report());
+			}, [&](sqlite3_stmt* stmt)
+			{
+				size_t fields = (std::min)(reader.size(), parameters.size());
+				for(size_t i = 0; i < fields; ++i)
+				{
+					if(0 == parameters[i]) continue;
+					auto& field = reader[i];
+					if(field.empty() && options.empty_as_null) sqlite3_bind_null(stmt, parameters[i]);
+					else sqlite3_bind_text(stmt, parameters[i], field.data(), (int)field.size(), SQLITE_STATIC);
+				}
+				for(size_t i = fields; i < parameters.size(); ++i)
+					if(parameters[i]) sqlite3_bind_null(stmt, parameters[i]);
+				bind_where(stmt, keys.size());
+			});
+			if(options.progress) report();
+			stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+			return stats;
+		}
+		//streams the selection as an arrow ipc stream, one record batch per batch_rows rows. when it throws, out is
+		//left without the end-of-stream marker.
+		export_stats export_arrow(std::ostream& out, size_t batch_rows = 65536)const
+		{
+			auto c = query();
+			return arrow_stream_writer(out).write(*c, batch_rows);
+		}
+		//the same into a file, which is removed when the export fails, so a partial stream is never left behind.
+		export_stats export_arrow(const boost::filesystem::path& target, size_t batch_rows = 65536)const
+		{
+			boost::filesystem::ofstream out(target, std::ios::binary);
+			if(false == out.is_open())
+				commit_error(L"cannot open " + target.wstring());
+			try
+			{
+				return export_arrow(out, batch_rows);
+			}
+			catch(...)
+			{
+				out.close();
+				boost::system::error_code ec;
+				boost::filesystem::remove(target, ec);
+				throw;
+			}
+		}
+		std::future<std::shared_ptr<sqlite_hsd::table>> select_async()const
+		{
+			return database->select_async(select_command(), start, count);
+		}
+		template<typename ValueType>
+		std::future<void> insert_async(const custom::value_map_t<ValueType>& values)const
+		{
+			auto self = *this;
+			return database->post([self, values](dao&) {self.execute_insert(values);});
+		}
+		//queues the insert, or the |= update-or-insert, for the dao's group commit writer.
+		template<typename ValueType>
+		std::future<size_t> insert_grouped(const custom::value_map_t<ValueType>& values)const
+		{
+			auto self = *this;
+			return database->submit_write([self, values](dao&) {self.execute_insert(values); return (size_t)1;}, payload_bytes(values));
+		}
+		template<typename ValueType>
+		std::future<size_t> upsert_grouped(const custom::value_map_t<ValueType>& values)const
+		{
+			auto self = *this;
+			return database->submit_write([self, values](dao&) {self |= values; return (size_t)1;}, payload_bytes(values));
+		}
+		//keyset paging: fills t with up to page_size rows ordered by key that come after token, and returns the token
+		//for the following page. every page after the first runs the same statement, so the cost does not grow with depth.
+		//key must be unique, or rows sharing a key across a page boundary are skipped. start and count are ignored.
+		page_token next_page(const wstring& key, size_t page_size, sqlite_hsd::table& t, const page_token& token = page_token())const
+		{
+			if(token.finished)
+			{
+				t.clear(false);
+				return token;
+			}
+			command cmd = where_command(L"");
+			wstring conds = where_clause;
+			if(token.started)
+			{
+				//the where clause is parenthesized so an or in it does not escape the seek.
+				conds = conds.size() ? L"where (" + conds.substr(6) + L") and " : L"where ";
+				conds += key + L" > :seek_key";
+				cmd.bind_parameter(L"seek_key", token.last_key);
+			}
+			//the key is selected once more as the last column, so it is read whether or not it is among the
+			//selected columns, including rowid which select * does not return.
+			boost::wformat fmt(L"select %1%,%2% as [sqlite_hsd_page_key] from [%3%] %4% order by %2% limit :seek_count");
+			cmd.set_cmd_text((fmt % select_columns() % key % table % conds).str());
+			cmd.bind_parameter(L"seek_count", (int64_t)page_size);
+			database->execute(cmd, &t);
+			if(0 == t.column_number())
+				commit_error(L"next_page: cannot read the key " + key);
+
+			page_token next;
+			next.started = true;
+			next.finished = (size_t)t.row_number() < page_size;
+			next.last_key = token.last_key;
+			if(t.row_number())
+			{
+				next.last_key = t[t.row_number() - 1][(int)t.column_number() - 1];
+				if(next.last_key.empty())
+					commit_error(L"next_page: the key " + key + L" is null");
+			}
+			t._remove_last_column();
+			return next;
+		}
+		page_token next_page(const string& key, size_t page_size, sqlite_hsd::table& t, const page_token& token = page_token())const
+		{
+			return next_page(narrow_to_unicode(key), page_size, t, token);
+		}
+		std::unique_ptr<cursor> query()const
+		{
+			return database->query(select_command(), start, count);
+		}
 		void create_table(const wstring& keys)
 		{
 			try{
@@ -655,9 +4210,27 @@ namespace sqlite_hsd
 			database->execute((boost::wformat(L"select count(*) from [%1%]") % table).str(), &t);
 			return t[0][0];
 		}
-		void create_table(const string& keys) {create_table(codepage::acp_to_unicode(keys));}
+		void create_table(const string& keys) {create_table(narrow_to_unicode(keys));}
 		std::shared_ptr<dao> get_database() {return database;}
+		//renders and resolves the selection once, with the rows the adapter was limited to. see compiled_query.
+		compiled_query compile()const
+		{
+			auto text = (boost::wformat(L"select %1% from [%2%] %3%") % select_columns() % table % where_clause).str();
+			return compiled_query(database, text + codepage::utf8_to_unicode(limit_clause(start, count)), where_values);
+		}
 	private:
+		command select_command()const
+		{
+			return where_command((boost::wformat(L"select %1% from [%2%] %3%") % select_columns() % table % where_clause).str());
+		}
+		//a command over text with the values of the predicates in the where clause bound.
+		command where_command(const wstring& text)const
+		{
+			command cmd(text);
+			BOOST_FOREACH(auto& it, where_values)
+				cmd.bind_unnamed(it);
+			return cmd;
+		}
 		wstring select_columns()const
 		{
 			wstring keys;
@@ -697,7 +4270,7 @@ namespace sqlite_hsd
 		void execute_delete(const custom::value_map_t<ValueType>& values)const
 		{
 			wstring conds;
-			command cmd;
+			command cmd = where_command(L"");
 			boost::wformat fmt(L"delete from [%1%] %2%");
 			conds = where_clause;
 			BOOST_FOREACH(auto& it, values)
@@ -714,7 +4287,7 @@ namespace sqlite_hsd
 		void execute_update(const custom::value_map_t<ValueType>& values, bool insertIfNonExistent)const
 		{
 			wstring conds;
-			command cmd;
+			command cmd = where_command(L"");
 			boost::wformat fmt(L"update [%1%] set %2% %3%");
 			BOOST_FOREACH(auto& it, values)
 			{
@@ -728,6 +4301,217 @@ namespace sqlite_hsd
 			if(0 == database->execute(cmd) && insertIfNonExistent)
 				execute_insert(values);
 		}
+		//runs the statements once for every row next moves to, each with the row bound by bind, committing every
+		//chunk_size rows. joins the caller's transaction if one is open.
+		void bulk_insert(const vector<wstring>& sql, size_t chunk_size, bulk_insert_stats& stats, const std::function<bool()>& next,
+			const std::function<void(sqlite3_stmt*)>& bind)const
+		{
+			vector<sqlite3_stmt*> statements;
+			std::function<void(size_t)> use = [&](size_t i)
+			{
+				if(i == sql.size()) step_rows(statements, chunk_size, stats, next, bind);
+				else database->use_statement(sql[i], [&](sqlite3_stmt* stmt)
+				{
+					statements.push_back(stmt);
+					use(i + 1);
+				});
+			};
+			use(0);
+		}
+		void step_rows(const vector<sqlite3_stmt*>& statements, size_t chunk_size, bulk_insert_stats& stats, const std::function<bool()>& next,
+			const std::function<void(sqlite3_stmt*)>& bind)const
+		{
+			//the statements of one row are always written in one transaction.
+			bool owns_transaction = 0 != sqlite3_get_autocommit(sqlite3_db_handle(statements[0])) && (chunk_size > 1 || statements.size() > 1);
+			bool in_transaction = false;
+			size_t pending = 0;
+			try
+			{
+				while(next())
+				{
+					if(owns_transaction && false == in_transaction)
+					{
+						database->begin_transaction();
+						in_transaction = true;
+					}
+					BOOST_FOREACH(auto stmt, statements)
+					{
+						bind(stmt);
+						int ret = sqlite3_step(stmt);
+						sqlite3_reset(stmt);
+						if(SQLITE_DONE != ret)
+							commit_error(codepage::acp_to_unicode(sqlite3_errmsg(sqlite3_db_handle(stmt))));
+					}
+					++stats.rows;
+					if(in_transaction && ++pending == chunk_size)
+					{
+						database->commit_transaction();
+						in_transaction = false;
+						pending = 0;
+					}
+				}
+				if(in_transaction)
+				{
+					database->commit_transaction();
+					in_transaction = false;
+				}
+			}
+			catch(...)
+			{
+				if(in_transaction)
+					database->rollback_transaction();
+				throw;
+			}
+		}
+		//writes one row through the insert statements, see insert_statements.
+		void insert_row(const vector<wstring>& keys, const std::function<void(sqlite3_stmt*)>& bind)const
+		{
+			bulk_insert_stats stats = {0, 0};
+			bulk_insert(insert_statements(keys), 1, stats, [&stats]() {return 0 == stats.rows;}, [&](sqlite3_stmt* stmt)
+			{
+				bind(stmt);
+				bind_where(stmt, keys.size());
+			});
+		}
+		template<typename ValueType>
+		void execute_upsert(const custom::value_map_t<ValueType>& values)const
+		{
+			auto keys = insert_columns(values);
+			insert_row(keys, [&](sqlite3_stmt* stmt) {bind_row(stmt, values, keys);});
+		}
+		//the statements that write a row of keys, bound to parameters 1 to keys.size() and followed by the values of
+		//the where clause: a plain insert, or an upsert on conflict_columns. the on conflict clause needs sqlite 3.24,
+		//which is checked on the library that is running. on older ones the upsert is an update of the row with the
+		//same key followed by an insert of the row when there is none, so in both the columns not given are kept.
+		vector<wstring> insert_statements(const vector<wstring>& keys)const
+		{
+			auto values = parameter_list(keys.size());
+			vector<wstring> sql;
+			wstring updates, matches;
+			bool keyed = true;
+			BOOST_FOREACH(auto& c, conflict_columns)
+			{
+				auto itr = std::find_if(keys.begin(), keys.end(), [&c](const wstring& it) {return boost::iequals(c, it);});
+				if(keys.end() == itr) keyed = false;
+				else matches += (matches.size() ? L" and " : L"") + c + L"=?" + std::to_wstring(itr - keys.begin() + 1);
+			}
+			for(size_t i = 0; i < keys.size(); ++i)
+			{
+				bool key = false;
+				BOOST_FOREACH(auto& c, conflict_columns)
+					if(boost::iequals(c, keys[i])) key = true;
+				if(key) continue;
+				if(updates.size()) updates += L",";
+				updates += sqlite3_libversion_number() >= 3024000 ? keys[i] + L"=excluded." + keys[i] : keys[i] + L"=?" + std::to_wstring(i + 1);
+			}
+
+			if(conflict_columns.empty() || (sqlite3_libversion_number() < 3024000 && false == keyed))
+				sql.push_back((boost::wformat(L"insert into [%1%](%2%) values(%3%)") % table % boost::join(keys, L",") % values).str());
+			else if(sqlite3_libversion_number() >= 3024000)
+			{
+				boost::wformat fmt(L"insert into [%1%](%2%) values(%3%) on conflict(%4%) do %5%");
+				sql.push_back((fmt % table % boost::join(keys, L",") % values % boost::join(conflict_columns, L",")
+					% (updates.empty() ? wstring(L"nothing") : L"update set " + updates + (where_clause.size() ? L" " + where_clause : L""))).str());
+			}
+			else
+			{
+				if(updates.size())
+				{
+					boost::wformat fmt(L"update [%1%] set %2% where %3%%4%");
+					sql.push_back((fmt % table % updates % matches % (where_clause.size() ? L" and (" + where_clause.substr(6) + L")" : L"")).str());
+				}
+				wstring numbered;
+				for(size_t i = 0; i < keys.size(); ++i)
+					numbered += (i ? L",?" : L"?") + std::to_wstring(i + 1);
+				boost::wformat fmt(L"insert into [%1%](%2%) select %3% where not exists (select 1 from [%1%] where %4%)");
+				sql.push_back((fmt % table % boost::join(keys, L",") % numbered % matches).str());
+			}
+			return sql;
+		}
+		template<typename ValueType>
+		static size_t payload_bytes(const custom::value_map_t<ValueType>& values)
+		{
+			size_t bytes = 0;
+			BOOST_FOREACH(auto& it, values)
+				bytes += it.first.size() * sizeof(wchar_t) + payload_bytes(it.second);
+			return bytes;
+		}
+		static size_t payload_bytes(const value_t& value)
+		{
+			auto& v = (const __value_t&)value;
+			if(value_t::text_value == value.which()) return boost::get<text_t>(v).size() * sizeof(text_t::value_type);
+			if(value_t::blob_value == value.which()) return boost::get<vector<char>>(v).size();
+			return sizeof(value_t);
+		}
+		template<typename ValueType>
+		static size_t payload_bytes(const basic_string<ValueType>& value) {return value.size() * sizeof(ValueType);}
+		static wstring parameter_list(size_t count)
+		{
+			wstring parameters;
+			for(size_t i = 0; i < count; ++i)
+				parameters += i ? L",?" : L"?";
+			return parameters;
+		}
+		template<typename ValueType>
+		vector<wstring> insert_columns(const custom::value_map_t<ValueType>& values)const
+		{
+			vector<wstring> keys;
+			BOOST_FOREACH(auto& it, values)
+			{
+				if(0 != columns.size() && false == name_in_columns(it.first))
+					continue;
+				keys.push_back(it.first);
+			}
+			return keys;
+		}
+		template<typename ValueType>
+		void check_columns(const custom::value_map_t<ValueType>& values, const vector<wstring>& keys)const
+		{
+			size_t found = 0;
+			BOOST_FOREACH(auto& it, values)
+			{
+				if(0 != columns.size() && false == name_in_columns(it.first))
+					continue;
+				if(keys.end() == std::find(keys.begin(), keys.end(), it.first))
+					commit_error(L"insert_many: column " + it.first + L" is not in the first row");
+				++found;
+			}
+			if(found != keys.size())
+				commit_error(L"insert_many: a row does not have all the columns of the first row");
+		}
+		template<class Record>
+		typename enable_if<is_mapped_record<Record>::value>::type check_columns(const Record&, const vector<wstring>&)const {}
+		template<class Record>
+		typename enable_if<is_mapped_record<Record>::value, vector<wstring>>::type insert_columns(const Record&)const
+		{
+			vector<wstring> keys;
+			boost::split(keys, record_mapper<Record>::column_list(), boost::is_any_of(L","));
+			return keys;
+		}
+		//the values of the where clause follow the row in an upsert, and are not there in a plain insert.
+		void bind_where(sqlite3_stmt* stmt, size_t row_parameters)const
+		{
+			if(sqlite3_bind_parameter_count(stmt) < (int)(row_parameters + where_values.size())) return;
+			for(size_t i = 0; i < where_values.size(); ++i)
+				bind_value(stmt, (int)(row_parameters + i) + 1, where_values[i], SQLITE_STATIC);
+		}
+		//only a value_t is bound as it is. any other ValueType is bound through a temporary value_t, which sqlite must copy.
+		template<typename ValueType>
+		static void bind_row(sqlite3_stmt* stmt, const custom::value_map_t<ValueType>& values, const vector<wstring>& keys)
+		{
+			auto destructor = is_same<ValueType, value_t>::value ? SQLITE_STATIC : SQLITE_TRANSIENT;
+			for(size_t i = 0; i < keys.size(); ++i)
+			{
+				auto itr = values.find(keys[i]);
+				if(values.end() == itr) sqlite3_bind_null(stmt, (int)i + 1);
+				else bind_value(stmt, (int)i + 1, itr->second, destructor);
+			}
+		}
+		template<class Record>
+		static typename enable_if<is_mapped_record<Record>::value>::type bind_row(sqlite3_stmt* stmt, const Record& r, const vector<wstring>&)
+		{
+			record_mapper<Record>::bind(stmt, r);
+		}
 		bool name_in_columns(const wstring& name)const
 		{
 			BOOST_FOREACH(auto& it, columns)
@@ -0,0 +1,993 @@
+// tests.cpp : Regression checks for sqlite.hpp. Every test runs against a fresh database file in the temp directory.
+//
+// Built by the tests project of sqlite-dao.sln. On Linux, with the custom headers on the include path, e.g.
+//	g++ -std=c++14 -I<custom headers> tests.cpp -lsqlite3 -lboost_thread -lboost_filesystem -lboost_system -lpthread
+// and once more with -DSQLITE_HSD_SYSTEM_SQLITE, which also runs the tests of the api that needs a newer sqlite, and with
+// -DSQLITE_HSD_UTF8 for the utf-8 text mode.
+// Exits with the number of failed checks.
+//
+
+#include "sqlite.hpp"
+#include <iostream>
+#include <sstream>
+using namespace sqlite_hsd;
+
+static int g_failures = 0;
+
+#define CHECK(condition)	\
+	do { if(false == (condition)) {++g_failures; cout << __FILE__ << "(" << __LINE__ << "): " << #condition << endl;} } while(0)
+
+//a growing vector<value_t> moves its cells rather than copying them only when value_t cannot throw while moving
+static_assert(std::is_nothrow_move_constructible<value_t>::value && std::is_nothrow_move_assignable<value_t>::value, "value_t moves must be noexcept");
+
+struct mapped_person
+{
+	int64_t			id;
+	wstring			name;
+	string			nick;
+	double			score;
+	vector<char>	image;
+};
+RECORD_MAPPING(mapped_person, field(L"id", &mapped_person::id), field(L"name", &mapped_person::name), field(L"nick", &mapped_person::nick),
+	field(L"score", &mapped_person::score), field(L"image", &mapped_person::image));
+
+struct scratch_database
+{
+	boost::filesystem::path		path;
+	std::shared_ptr<dao>		database;
+
+	scratch_database() : path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sqlite-dao-%%%%%%%%.db")),
+		database(make_shared<dao>())
+	{
+		database->open(path);
+	}
+	~scratch_database()
+	{
+		database->close();
+		boost::system::error_code ec;
+		boost::filesystem::remove(path, ec);
+		boost::filesystem::remove(path.string() + "-wal", ec);
+		boost::filesystem::remove(path.string() + "-shm", ec);
+	}
+};
+
+//rows the adapter's selection matches. rows() counts the whole table.
+static long matching_rows(const table_adapter& a)
+{
+	table t;
+	a >> t;
+	return t.row_number();
+}
+
+//repeated statements are prepared once, the cache stays within its capacity and a schema change is picked up
+void statement_cache_reuse()
+{
+	scratch_database s;
+	auto& d = *s.database;
+	d.execute(wstring(L"create table cached(id int)"));
+	d.reset_statement_cache_stats();
+	for(int i = 0; i < 10; ++i)
+	{
+		command insert(L"insert into cached values(?)");
+		insert.bind_parameter(1, i);
+		d.execute(insert);
+	}
+	auto stats = d.statement_cache_stats();
+	CHECK(1 == stats.misses && 9 == stats.hits);
+
+	table t;
+	d.execute(wstring(L"select * from cached"), &t);
+	d.execute(wstring(L"alter table cached add column name text"));
+	d.execute(wstring(L"select * from cached"), &t);
+	CHECK(10 == t.row_number() && 2 == t.column_number());
+
+	d.set_statement_cache_size(1);
+	d.reset_statement_cache_stats();
+	for(int i = 0; i < 3; ++i)
+	{
+		d.execute(wstring(L"select id from cached"), &t);
+		d.execute(wstring(L"select name from cached"), &t);
+	}
+	stats = d.statement_cache_stats();
+	CHECK(1 == stats.size && 0 == stats.hits && 5 <= stats.evictions);
+}
+
+//a cursor steps rows lazily, frees the connection when a scan stops early and keeps its dao alive
+void cursor_streams_rows()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"streamed");
+	a.create_table(L"id int");
+	for(int i = 0; i < 10; ++i)
+		a += Values("id", i);
+
+	int64_t sum = 0;
+	auto c = s.database->query(wstring(L"select id from streamed order by id"));
+	for(auto& r : *c)
+		sum += (int64_t)r["id"];
+	CHECK(45 == sum && c->done());
+
+	int calls = 0;
+	a >> [&calls](const cursor::row&) {return ++calls < 3;};
+	CHECK(3 == calls);
+	auto writer = std::async(std::launch::async, [&a]() {a += Values("id", 10);});
+	CHECK(std::future_status::ready == writer.wait_for(std::chrono::seconds(5)));
+
+	auto d = make_shared<dao>();
+	d->open(s.path);
+	c = d->query(wstring(L"select id from streamed"));
+	d.reset();
+	calls = 0;
+	while(c->next()) ++calls;
+	CHECK(11 == calls);
+}
+
+//the zero-copy accessors read sqlite's own buffers: text as utf-8, blobs with embedded zeros, and nulls as empty views
+void cursor_row_accessors()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"cells");
+	a.create_table(L"i int, r real, t text, b blob, n int");
+	a += Values("i", 42)("r", 2.5)("t", wstring(L"h\u00e9llo"))("b", vector<char>{1, 0, 2});
+	int rows = 0;
+	a >> [&rows](const cursor::row& r)
+	{
+		++rows;
+		CHECK(SQLITE_INTEGER == r.type(0) && 42 == r.integer(L"i") && 2.5 == r.real(L"r"));
+		CHECK(std::string("h\xc3\xa9llo") == r.utf8(L"t").to_string());
+		auto b = r.blob(L"b");
+		CHECK(3 == b.size && (vector<char>{1, 0, 2}) == b.to_vector());
+		CHECK(r.is_null(L"n") && r.utf8(L"n").empty() && nullptr == r.blob(L"n").data);
+		bool unknown = false;
+		try {r.integer(L"missing");}
+		catch(...) {unknown = true;}
+		CHECK(unknown);
+		return true;
+	};
+	CHECK(1 == rows);
+}
+
+//mapped records are written and read by column name, without value_t, and null cells read as empty members
+void record_mapping_round_trip()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"people");
+	a.create_table(L"id integer primary key, extra text, name text, nick text, score real, image blob");
+	mapped_person tom = {1, L"Tom", "tommy", 1.5, vector<char>{1, 0, 2}};
+	a += tom;
+	vector<mapped_person> more(2, tom);
+	more[0].id = 2;
+	more[1].id = 3;
+	more[1].name = L"Ann";
+	CHECK(2 == a.insert_many(more).rows);
+	a += Values("id", 4);
+
+	vector<mapped_person> people;
+	a >> people;
+	CHECK(4 == people.size() && L"Tom" == people[0].name && "tommy" == people[0].nick && 1.5 == people[0].score);
+	CHECK((vector<char>{1, 0, 2}) == people[0].image && L"Ann" == people[2].name);
+	CHECK(4 == people[3].id && people[3].name.empty() && people[3].image.empty() && 0 == people[3].score);
+	a[L"id > 2"] >> people;
+	CHECK(2 == people.size() && 3 == people[0].id);
+}
+
+//asynchronous calls run on the dao's workers, carry their errors in the future and fail fast on a full queue
+void async_calls()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"queued");
+	a.create_table(L"id int");
+	vector<std::future<void>> inserts;
+	for(int i = 0; i < 5; ++i)
+		inserts.push_back(a.insert_async(Values("id", i)));
+	BOOST_FOREACH(auto& it, inserts)
+		it.get();
+	CHECK(5 == a.select_async().get()->row_number());
+	CHECK(5 == s.database->post([](dao& d) {return table_adapter(d.shared_from_this(), L"queued").rows();}).get());
+	bool failed = false;
+	try {s.database->execute_async(wstring(L"select * from missing")).get();}
+	catch(...) {failed = true;}
+	CHECK(failed);
+
+	async_options options = {1, 1, false};
+	s.database->set_async_options(options);
+	std::promise<void> started, gate;
+	auto open = gate.get_future().share();
+	auto busy = s.database->post([&started, open](dao&) {started.set_value(); open.wait(); return 1;});
+	started.get_future().wait();
+	auto queued = s.database->post([](dao&) {return 2;});
+	auto rejected = s.database->post([](dao&) {return 3;});
+	failed = false;
+	try {rejected.get();}
+	catch(...) {failed = true;}
+	CHECK(failed);
+	gate.set_value();
+	CHECK(1 == busy.get() && 2 == queued.get());
+}
+
+//text round-trips through sqlite unchanged whichever string type holds it. with SQLITE_HSD_UTF8 cells hold the utf-8
+//bytes sqlite stores, and narrow arguments are taken as utf-8.
+void text_round_trip()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"texts");
+	a.create_table(L"id int, t text");
+	wstring wide = L"h\u00e9llo \u4e16\u754c";
+	string utf8 = "h\xc3\xa9llo \xe4\xb8\x96\xe7\x95\x8c";
+	a += Values("id", 1)("t", wide);
+	table t;
+	a >> t;
+	CHECK(wide == t[0]["t"].to<wstring>() && value_t::text_value == t[0]["t"].which());
+	int64_t bytes = 0;
+	a(L"length(cast(t as blob)) as n") >> [&bytes](const cursor::row& r) {bytes = r.integer(0); return false;};
+	CHECK((int64_t)utf8.size() == bytes);
+#ifdef SQLITE_HSD_UTF8
+	CHECK(utf8 == t[0]["t"].to<string>());
+	a += Values("id", 2)("t", utf8);
+	a[L"id = 2"] >> t;
+	CHECK(wide == t[0]["t"].to<wstring>());
+	CHECK(2 == matching_rows(a[L"t = '" + wide + L"'"]));
+#endif
+}
+
+//a columnar column takes the type of its first cell and widens to fit later ones, while batches keep the first types
+void columnar_types()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"columns");
+	a.create_table(L"id int, n, t, b blob");
+	a += Values("id", 1)("n", 1)("t", 7);
+	a += Values("id", 2)("t", wstring(L"abc"))("b", vector<char>{1, 0});
+	a += Values("id", 3)("n", 2.5)("t", 8);
+
+	columnar_table c;
+	a >> c;
+	CHECK(3 == c.row_number() && 4 == c.column_number());
+	CHECK(SQLITE_INTEGER == c["id"].type() && 3 == c["id"].integers()[2]);
+	CHECK(SQLITE_FLOAT == c["n"].type() && 1.0 == c["n"].real(0) && c["n"].is_null(1) && 2.5 == c["n"].real(2));
+	CHECK(SQLITE_TEXT == c["t"].type() && "7" == c["t"].utf8(0).to_string() && L"abc" == c["t"].wtext(1));
+	CHECK(SQLITE_BLOB == c["b"].type() && c["b"].is_null(0) && 2 == c["b"].blob(1).size);
+	bool unknown = false;
+	try {c["missing"];}
+	catch(...) {unknown = true;}
+	CHECK(unknown);
+
+	columnar_table batch;
+	auto cursor = s.database->query(wstring(L"select id, n from columns order by id"));
+	CHECK(2 == batch.fill_batch(*cursor, 2) && SQLITE_INTEGER == batch["n"].type());
+	CHECK(1 == batch.fill_batch(*cursor, 2) && SQLITE_INTEGER == batch["n"].type() && 2 == batch["n"].integer(0) && 3 == batch["id"].integer(0));
+	CHECK(0 == batch.fill_batch(*cursor, 2) && 0 == batch.row_number());
+}
+
+//a table takes its rows from its arena, and a copy of it keeps its rows once the arena is gone
+void arena_backed_table()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"arena");
+	a.create_table(L"id int, name text");
+	{
+		TRANSACTION_SCOPE(*s.database);
+		for(int i = 0; i < 200; ++i)
+			a += Values("id", i)("name", L"name " + std::to_wstring(i));
+	}
+	table copy;
+	{
+		auto arena = make_shared<result_arena>(4096);
+		table t(arena);
+		a >> t;
+		auto stats = arena->statistics();
+		CHECK(200 == t.row_number() && stats.allocations > 0 && stats.blocks > 1 && stats.bytes_used <= stats.bytes_reserved);
+		copy = t;
+		CHECK(nullptr == copy.arena());
+		auto other = make_shared<result_arena>();
+		table again(other);
+		again = t;
+		CHECK(other == again.arena() && 200 == again.row_number() && other->statistics().allocations > 0);
+	}
+	CHECK(200 == copy.row_number() && 199 == (int64_t)copy[199]["id"] && L"name 199" == copy[199]["name"].to<wstring>());
+}
+
+//column handles are resolved once, case-insensitively and to the first of duplicate names, and unknown ones read null
+void column_handles()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"handles");
+	a.create_table(L"id int, Name text");
+	a += Values("id", 1)("Name", L"Tom");
+	table t;
+	s.database->execute(wstring(L"select id, name, id + 1 as ID from handles"), &t);
+	auto name = t.column("NAME"), id = t.column(L"Id"), missing = t.column("missing");
+	CHECK(name.valid() && 1 == name.index && 0 == id.index && false == missing.valid());
+	CHECK(L"Tom" == t[0][name].to<wstring>() && 1 == (int64_t)t[0][id] && 1 == (int64_t)t[0]["ID"]);
+	CHECK(value_t::null_value == t[0][missing].which() && value_t::null_value == t[0]["missing"].which());
+	CHECK(value_t::null_value == t[0][column_handle(5)].which());
+}
+
+//profiles group statements by their text with literals replaced, and count executions, rows and changes
+void statement_profiles()
+{
+	scratch_database s;
+	auto& d = *s.database;
+	d.execute(wstring(L"create table profiled(id int, name text)"));
+	d.execute(wstring(L"insert into profiled values(0, 'zero')"));
+	CHECK(d.statement_profiles().empty());
+
+	d.enable_profiling();
+	for(int i = 1; i <= 3; ++i)
+		d.execute((boost::wformat(L"insert into profiled values(%1%,  'n''%1%')") % i).str());
+	table t;
+	d.execute(wstring(L"select * from profiled order by name"), &t);
+	auto c = d.query(wstring(L"select * from profiled order by name"));
+	while(c->next());
+	auto profiles = d.statement_profiles();
+	CHECK(2 == profiles.size());
+	auto insert = profiles.find("insert into profiled values(?, ?)");
+	CHECK(profiles.end() != insert && 3 == insert->second.executions && 3 == insert->second.changes);
+	auto select = profiles.find("select * from profiled order by name");
+	CHECK(profiles.end() != select && 2 == select->second.executions && 8 == select->second.rows);
+	CHECK(select->second.total_seconds >= select->second.max_seconds && select->second.max_seconds > 0);
+#if SQLITE_VERSION_NUMBER >= 3006004
+	CHECK(2 == select->second.sorts && select->second.fullscan_steps >= 6);
+#endif
+	d.reset_statement_profiles();
+	CHECK(d.statement_profiles().empty());
+}
+
+//parameters bound by index, unnamed or from borrowed buffers reach the statement, and a reused statement forgets them
+void indexed_and_borrowed_binds()
+{
+	scratch_database s;
+	auto& d = *s.database;
+	d.execute(wstring(L"create table bound(id int, name text, data blob)"));
+	vector<char> data{1, 0, 2, 0};
+	string name = "h\xc3\xa9llo";
+	command insert(L"insert into bound values(?1, ?2, ?3)");
+	insert.bind_parameter(1, 1);
+	insert.bind_text(2, name.data(), name.size());
+	insert.bind_blob(3, data.data(), data.size());
+	d.execute(insert);
+	command partial(L"insert into bound values(?1, ?2, ?3)");
+	partial.bind_parameter(1, 2);
+	d.execute(partial);
+	command unnamed(L"insert into bound values(?, ?, ?)");
+	unnamed.bind_unnamed(3);
+	unnamed.bind_unnamed(L"three");
+	unnamed.bind_unnamed(vector<char>{3});
+	d.execute(unnamed);
+
+	table t;
+	command select(L"select * from bound where id >= ? order by id");
+	select.bind_unnamed(1);
+	d.execute(select, &t);
+	CHECK(3 == t.row_number());
+	CHECK(L"h\u00e9llo" == t[0]["name"].to<wstring>() && data == t[0]["data"].to<vector<char>>());
+	CHECK(value_t::null_value == t[1]["name"].which() && value_t::null_value == t[1]["data"].which());
+	CHECK(L"three" == t[2]["name"].to<wstring>() && (vector<char>{3}) == t[2]["data"].to<vector<char>>());
+}
+
+//typed predicates bind their values, keep c++ precedence in the sql, and share one statement whatever the values
+void typed_predicates()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"filtered");
+	a.create_table(L"id int, name text, age int");
+	for(int i = 0; i < 10; ++i)
+	{
+		auto values = Values("id", i)("name", L"n" + std::to_wstring(i));
+		if(i % 3) values("age", 20 + i);
+		a += values;
+	}
+	CHECK(3 == matching_rows(a[col("id") > 5 && col("name") != L"n7"]));
+	CHECK(3 == matching_rows(a[(col("id") < 2 || col("id") > 7) && col("id") != 1]));
+	CHECK(3 == matching_rows(a[!col("id").between(2, 8)]));
+	CHECK(2 == matching_rows(a[col("id").in(vector<value_t>{1, 3, 99})]) && 0 == matching_rows(a[col("id").in(vector<value_t>())]));
+	CHECK(4 == matching_rows(a[col("age").is_null()]) && 6 == matching_rows(a[col("age").is_not_null()]));
+	CHECK(1 == matching_rows(a[col("name").like(L"%9")]) && 0 == matching_rows(a[col("name") == L"x' or '1'='1"]));
+
+	s.database->reset_statement_cache_stats();
+	table t;
+	a[col("id") == 1] >> t;
+	a[col("id") == 2] >> t;
+	CHECK(1 == t.row_number() && 2 == (int64_t)t[0]["id"] && 1 == s.database->statement_cache_stats().hits);
+
+	a[col("id") >= 8] ^= Values("name", L"late");
+	CHECK(2 == matching_rows(a[col("name") == L"late"]));
+	a -= col("age").is_null() || col("id") == 1;
+	CHECK(5 == a.rows());
+}
+
+//a compiled query takes its open parameters per call, keeps the values of its predicates and checks its arguments
+void compiled_query_parameters()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"compiled");
+	a.create_table(L"id int, name text, age int");
+	for(int i = 0; i < 10; ++i)
+		a += Values("id", i)("name", L"n" + std::to_wstring(i))("age", 20 + i);
+
+	auto q = a("id")("name")[L"age >= :min and name <> ? order by id"].compile();
+	CHECK(2 == q.parameter_count());
+	table t;
+	CHECK(4 == q.fill(t, 25, string("n7")) && 2 == t.column_number() && 5 == (int64_t)t[0]["id"] && 8 == (int64_t)t[2]["id"]);
+	CHECK(2 == q.fill(t, 28, wstring(L"n1")) && 8 == (int64_t)t[0]["id"] && L"n9" == t[1]["name"].to<wstring>());
+	bool rejected = false;
+	try {q.fill(t, 25);}
+	catch(...) {rejected = true;}
+	CHECK(rejected);
+
+	auto bound = a[col("age") > 25 && col("name") != L"n8"].compile();
+	CHECK(0 == bound.parameter_count() && 3 == bound()->row_number());
+	a += Values("id", 10)("name", L"n10")("age", 30);
+	CHECK(4 == bound()->row_number());
+}
+
+//value_t reports the kind it holds, converts between numbers and text, and refuses conversions it has none for
+void value_kinds()
+{
+	value_t null, integer(42), real(2.5), text(wstring(L"17")), narrow(string("x")), blob(vector<char>{1, 0});
+	CHECK(value_t::null_value == null.which() && null.empty() && value_t::integer_value == integer.which());
+	CHECK(value_t::real_value == real.which() && value_t::text_value == text.which() && value_t::text_value == narrow.which());
+	CHECK(value_t::blob_value == blob.which() && typeid(vector<char>) == blob.type());
+	CHECK(42.0 == integer.to<double>() && 2 == real.to<int64_t>() && 42 == integer.to<int>() && integer.to_bool());
+	CHECK(L"42" == integer.to<wstring>() && "42" == integer.to<string>() && L"2.5" == real.to<wstring>());
+	CHECK(17 == text.to<int64_t>() && 17.0 == text.to<double>() && "x" == narrow.to<string>());
+	int refused = 0;
+	try {null.to<int64_t>();}
+	catch(...) {++refused;}
+	try {integer.to<vector<char>>();}
+	catch(...) {++refused;}
+	CHECK(2 == refused);
+
+	auto data = blob.to<vector<char>>();
+	blob.assign_blob("\3", 1);
+	CHECK(value_t::blob_value == blob.which() && (vector<char>{3}) == blob.to<vector<char>>());
+	integer.assign_text("abc", 3);
+	CHECK(value_t::text_value == integer.which() && L"abc" == integer.to<wstring>());
+	value_t moved(std::move(integer));
+	CHECK(L"abc" == moved.to<wstring>());
+
+	scratch_database s;
+	table_adapter a(s.database, L"kinds");
+	a.create_table(L"i, r, t, b, n");
+	a += Values("i", 1)("r", 0.5)("t", L"one")("b", data);
+	table t;
+	a >> t;
+	CHECK(value_t::integer_value == t[0]["i"].which() && value_t::real_value == t[0]["r"].which());
+	CHECK(value_t::text_value == t[0]["t"].which() && value_t::blob_value == t[0]["b"].which() && t[0]["n"].empty());
+	CHECK(data == t[0]["b"].to<vector<char>>());
+}
+
+//cached selects share one snapshot per statement and values until a write to a table they read commits
+void result_cache_snapshots()
+{
+	scratch_database s;
+	auto& d = *s.database;
+	d.enable_result_cache(1 << 20);
+	table_adapter a(s.database, L"cached"), other(s.database, L"other");
+	a.create_table(L"id int");
+	other.create_table(L"id int");
+	a += Values("id", 1);
+	std::shared_ptr<const table> first, again, filtered;
+	a >> first;
+	a >> again;
+	a[col("id") == 2] >> filtered;
+	CHECK(first == again && 1 == first->row_number() && 0 == filtered->row_number());
+	auto stats = d.result_cache_statistics();
+	CHECK(1 == stats.hits && 2 == stats.misses && 2 == stats.entries && stats.bytes > 0);
+
+	other += Values("id", 1);
+	a >> again;
+	CHECK(first == again);
+	a += Values("id", 2);
+	a >> again;
+	a[col("id") == 2] >> filtered;
+	CHECK(first != again && 2 == again->row_number() && 1 == first->row_number() && 1 == filtered->row_number());
+	CHECK(d.result_cache_statistics().invalidations > 0);
+
+	d.enable_result_cache(0);
+	a >> first;
+	a >> again;
+	CHECK(first != again && 0 == d.result_cache_statistics().entries);
+}
+
+//every subscriber sees committed inserts, updates and deletes in order, never rolled back ones, and a full feed drops
+void change_feed_events()
+{
+	scratch_database s;
+	auto& d = *s.database;
+	table_adapter a(s.database, L"journal");
+	a.create_table(L"id integer primary key, name text");
+	auto feed = d.subscribe_changes(), small = d.subscribe_changes(2);
+	a += Values("id", 1)("name", L"one");
+	a[col("id") == 1] ^= Values("name", L"uno");
+	a -= Values("id", 1);
+	d.begin_transaction();
+	a += Values("id", 2);
+	d.rollback_transaction();
+
+	change_event e;
+	int ops[] = {SQLITE_INSERT, SQLITE_UPDATE, SQLITE_DELETE};
+	uint64_t sequence = 0;
+	for(int i = 0; i < 3; ++i)
+	{
+		CHECK(feed->try_pop(e) && ops[i] == e.op && "journal" == e.table && 1 == e.rowid && e.sequence > sequence);
+		sequence = e.sequence;
+	}
+	CHECK(false == feed->try_pop(e) && 0 == feed->dropped());
+	CHECK(2 == small->capacity() && 2 == small->size() && 1 == small->dropped());
+}
+
+//rows bound from the read buffer must be stepped before the reader refills it
+void import_across_buffer_boundaries()
+{
+	scratch_database s;
+	auto csv = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sqlite-dao-%%%%%%%%.csv");
+	{
+		boost::filesystem::ofstream out(csv, std::ios::binary);
+		out << "id,name,note\n";
+		for(int i = 0; i < 20000; ++i)
+			out << i << ",name " << i << ",\"quoted, " << i * 7 << "\"\n";
+	}
+	table_adapter a(s.database, L"imported");
+	a.create_table(L"id integer primary key, name text, note text");
+	import_options options;
+	options.buffer_size = 4096;
+	options.chunk_size = 1000;
+	auto stats = a.import_delimited(csv, options);
+	boost::system::error_code ec;
+	boost::filesystem::remove(csv, ec);
+
+	CHECK(20000 == stats.rows);
+	table t;
+	a >> t;
+	CHECK(20000 == t.row_number());
+	int mismatches = 0;
+	for(int i = 0; i < t.row_number(); ++i)
+	{
+		int64_t id = t[i]["id"];
+		wstring name = t[i]["name"], note = t[i]["note"];
+		if(id != i || name != L"name " + std::to_wstring(i) || note != L"quoted, " + std::to_wstring(i * 7))
+			++mismatches;
+	}
+	CHECK(0 == mismatches);
+}
+
+//only a quote that starts a field opens a quoted field, so a stray quote does not swallow the following lines
+void import_stray_quotes()
+{
+	scratch_database s;
+	auto csv = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sqlite-dao-%%%%%%%%.csv");
+	{
+		boost::filesystem::ofstream out(csv, std::ios::binary);
+		out << "id,name\n1,5\" screen\n2,b\n3,\"c, \"\"quoted\"\"\nline\"\n4,d\n";
+	}
+	table_adapter a(s.database, L"imported");
+	a.create_table(L"id integer primary key, name text");
+	auto stats = a.import_delimited(csv);
+	boost::system::error_code ec;
+	boost::filesystem::remove(csv, ec);
+
+	CHECK(4 == stats.rows);
+	table t;
+	a >> t;
+	CHECK(4 == t.row_number());
+	if(4 != t.row_number()) return;
+	wstring first = t[0]["name"], third = t[2]["name"], fourth = t[3]["name"];
+	CHECK(L"5\" screen" == first && L"c, \"quoted\"\nline" == third && L"d" == fourth);
+}
+
+//progress is reported every progress_rows rows and at the end, only at the end with 0, and returning false stops the import
+void import_progress_calls()
+{
+	scratch_database s;
+	auto csv = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sqlite-dao-%%%%%%%%.tsv");
+	{
+		boost::filesystem::ofstream out(csv, std::ios::binary);
+		for(int i = 0; i < 1000; ++i)
+			out << i << "\t" << i * 2 << "\n";
+	}
+	table_adapter a(s.database, L"imported");
+	a.create_table(L"id integer primary key, twice int");
+	import_options options('\t', 0);
+	options.header = false;
+	options.columns.push_back(L"id");
+	options.columns.push_back(L"twice");
+	int calls = 0;
+	uint64_t last_rows = 0;
+	options.progress = [&](const import_progress& p) {++calls; last_rows = p.rows; return true;};
+	options.progress_rows = 0;
+	CHECK(1000 == a.import_delimited(csv, options).rows);
+	CHECK(1 == calls && 1000 == last_rows);
+
+	a -= Values;
+	calls = 0;
+	options.progress_rows = 100;
+	a.import_delimited(csv, options);
+	CHECK(10 == calls && 1000 == a.rows());
+
+	a -= Values;
+	options.progress = [&](const import_progress& p) {return p.rows < 300;};
+	CHECK(300 == a.import_delimited(csv, options).rows);
+	boost::system::error_code ec;
+	boost::filesystem::remove(csv, ec);
+}
+
+//an arrow export whose later batches hold other types still completes with the end-of-stream marker, and a failed
+//export to a file removes the file
+void arrow_export_types()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"exported");
+	a.create_table(L"id integer primary key, n int, name text, v");
+	a += Values("id", 1)("n", 1)("name", L"one")("v", 1);
+	a += Values("id", 2)("n", 2)("name", L"two")("v", 2);
+	a += Values("id", 3)("n", L"abc")("name", 3)("v", L"three");
+	a += Values("id", 4)("n", 4.5)("name", vector<char>(3, 'x'))("v", 4.5);
+	auto target = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sqlite-dao-%%%%%%%%.arrows");
+	auto stats = a.export_arrow(target, 2);
+	CHECK(4 == stats.rows && 2 == stats.batches);
+	uint32_t end[2] = {0, 1};
+	{
+		boost::filesystem::ifstream in(target, std::ios::binary);
+		in.seekg(-8, std::ios::end);
+		in.read((char*)end, sizeof(end));
+	}
+	CHECK(0xffffffff == end[0] && 0 == end[1]);
+
+	a += Values("id", 5)("n", INT64_MIN);
+	bool failed = false;
+	try {a("id")(L"abs(n)").export_arrow(target, 2);}
+	catch(...) {failed = true;}
+	CHECK(failed && false == boost::filesystem::exists(target));
+	boost::system::error_code ec;
+	boost::filesystem::remove(target, ec);
+}
+
+#if SQLITE_VERSION_NUMBER >= 3004000
+//a blob written in chunks through a stream reads back whole, through the writer and through a pooled reader
+void blob_stream_round_trip()
+{
+	scratch_database s;
+	table_adapter(s.database, L"images").create_table(L"id integer primary key, data blob");
+	auto d = make_shared<dao>();
+	d->open(s.path, L"", 1);
+	string data(300000, 0);
+	for(size_t i = 0; i < data.size(); ++i)
+		data[i] = (char)(i * 31 % 251);
+	d->execute(wstring(L"insert into images(id, data) values(1, zeroblob(300000))"));
+	d->execute(wstring(L"insert into images(id, data) values(2, x'010203')"));
+	{
+		auto w = d->open_blob("images", "data", 1, blob_write);
+		std::istringstream in(data);
+		CHECK(data.size() == w->copy_from(in, 4096) && w->eof());
+		bool refused = false;
+		try {w->write("x", 1);}
+		catch(...) {refused = true;}
+		CHECK(refused);
+	}
+	auto r = d->open_blob("images", "data", 1);
+	std::ostringstream out;
+	CHECK(data.size() == r->copy_to(out, 4096) && out.str() == data);
+	r->seek(1000);
+	char chunk[16];
+	CHECK(16 == r->read(chunk, sizeof(chunk)) && 0 == memcmp(chunk, data.data() + 1000, sizeof(chunk)));
+#if SQLITE_VERSION_NUMBER >= 3007004
+	r->reopen(2);
+	CHECK(3 == r->size() && 3 == r->read(chunk, sizeof(chunk)) && 3 == chunk[2]);
+#endif
+	r.reset();
+
+	table t;
+	d->execute(command(L"select data from images where id = 1"), &t);
+	CHECK(t[0]["data"].to<vector<char>>() == vector<char>(data.begin(), data.end()));
+	d->close();
+}
+#endif
+
+//the result cache must not turn drop statements into no-ops
+void drop_with_result_cache()
+{
+	scratch_database s;
+	s.database->enable_result_cache(1 << 20);
+	table_adapter a(s.database, L"cached");
+	a.create_table(L"id integer primary key, name text");
+	a += Values("id", 1)("name", L"one");
+	s.database->execute(wstring(L"create index cached_name on cached(name)"));
+	s.database->execute(wstring(L"create view cached_view as select * from cached"));
+	CHECK(1 == s.database->select_cached(command(L"select * from cached"))->row_number());
+
+	table t;
+	s.database->execute(wstring(L"drop view cached_view"));
+	s.database->execute(wstring(L"drop index cached_name"));
+	s.database->execute(wstring(L"drop table cached"));
+	s.database->execute(command(L"select name from sqlite_master"), &t);
+	CHECK(0 == t.row_number());
+	a.create_table(L"id integer primary key, name text");
+	CHECK(0 == s.database->select_cached(command(L"select * from cached"))->row_number());
+}
+
+//a commit that fails and is retried publishes its changes once, and drops still work while changes are captured
+void changes_published_after_commit()
+{
+	scratch_database s;
+	table_adapter(s.database, L"events").create_table(L"id integer primary key, name text");
+	auto d = make_shared<dao>();
+	d->set_busy_timeout(0);
+	d->open(s.path);
+	auto feed = d->subscribe_changes();
+	change_event e;
+
+	//a reader in another connection keeps the commit from taking the exclusive lock
+	sqlite3* blocker = nullptr;
+	sqlite3_open(s.path.string().c_str(), &blocker);
+	sqlite3_exec(blocker, "begin; select * from events;", 0, 0, nullptr);
+	d->begin_transaction();
+	d->execute(wstring(L"insert into events values(1, 'one')"));
+	bool failed = false;
+	try {d->commit_transaction();}
+	catch(...) {failed = true;}
+	CHECK(failed);
+	CHECK(false == feed->try_pop(e));
+	sqlite3_exec(blocker, "commit;", 0, 0, nullptr);
+	sqlite3_close(blocker);
+	if(failed) d->commit_transaction();
+	CHECK(feed->try_pop(e) && 1 == e.rowid && SQLITE_INSERT == e.op);
+
+	table t;
+	d->execute(wstring(L"drop table events"));
+	d->execute(command(L"select name from sqlite_master"), &t);
+	CHECK(0 == t.row_number());
+	d->close();
+}
+
+//a grouped write can hold the last reference to the dao, which then stops the writer from the writer itself
+void grouped_write_outlives_dao()
+{
+	scratch_database s;
+	table_adapter(s.database, L"grouped").create_table(L"id int");
+	for(int round = 0; round < 20; ++round)
+	{
+		std::future<size_t> done;
+		{
+			auto d = make_shared<dao>();
+			d->open(s.path);
+			done = table_adapter(d, L"grouped").insert_grouped(Values("id", round));
+		}
+		CHECK(1 == done.get());
+	}
+	CHECK(20 == table_adapter(s.database, L"grouped").rows());
+}
+
+//a grouped write that fails after running statements leaves none of them committed, and the rest of its batch commits
+void failed_grouped_write_rolls_back()
+{
+	scratch_database s;
+	table_adapter(s.database, L"grouped").create_table(L"id int");
+	group_commit_options options = {64, 1 << 20, std::chrono::microseconds(50000), 1024};
+	s.database->set_group_commit_options(options);
+	auto insert = [](int id) {return [id](dao& d) {table_adapter(d.shared_from_this(), L"grouped") += Values("id", id); return (size_t)1;};};
+	auto first = s.database->submit_write(insert(1));
+	auto failed = s.database->submit_write([&insert](dao& d) -> size_t
+	{
+		insert(2)(d);
+		throw std::runtime_error("failed after its insert");
+	});
+	auto last = s.database->submit_write(insert(3));
+	CHECK(1 == first.get() && 1 == last.get());
+	bool reported = false;
+	try {failed.get();}
+	catch(const std::runtime_error&) {reported = true;}
+	CHECK(reported);
+	table t;
+	table_adapter(s.database, L"grouped") >> t;
+	CHECK(2 == t.row_number() && 1 == (int64_t)t[0]["id"] && 3 == (int64_t)t[1]["id"]);
+}
+
+//a compiled query keeps the rows the adapter was limited to
+void compiled_query_limits()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"paged");
+	a.create_table(L"id integer primary key");
+	for(int i = 0; i < 10; ++i)
+		a += Values("id", i);
+	table t;
+	a(0, 3).compile().fill(t);
+	CHECK(3 == t.row_number());
+	a(2, 3).compile().fill(t);
+	CHECK(3 == t.row_number() && 2 == (int64_t)t[0]["id"]);
+	a(7, (uint64_t)-1).compile().fill(t);
+	CHECK(3 == t.row_number());
+	a(7, (uint64_t)-1) >> t;
+	CHECK(3 == t.row_number());
+}
+
+//insert_many binds every row through one statement and rejects rows naming other columns. values that are not
+//value_t are bound through a temporary, so sqlite must copy them.
+void insert_many_rows()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"bulk");
+	a.create_table(L"id integer primary key, name text");
+	vector<mapped_table> rows;
+	for(int i = 0; i < 500; ++i)
+		rows.push_back(Values("id", i)("name", L"name " + std::to_wstring(i)));
+	CHECK(500 == a.insert_many(rows, 128).rows);
+	CHECK(500 == a.rows());
+	rows.push_back(Values("id", 500)("note", L"other"));
+	bool rejected = false;
+	try {a.insert_many(rows);}
+	catch(...) {rejected = true;}
+	CHECK(rejected && 500 == a.rows());
+
+	table_adapter blobs(s.database, L"blobs");
+	blobs.create_table(L"data blob");
+	vector<custom::value_map_t<vector<char>>> buffers(100);
+	for(int i = 0; i < 100; ++i)
+		buffers[i][L"data"] = vector<char>(100 + i, (char)i);
+	blobs.insert_many(buffers);
+	table t;
+	blobs >> t;
+	int mismatches = 0;
+	for(int i = 0; i < t.row_number(); ++i)
+		if(t[i]["data"].to<vector<char>>() != buffers[i][L"data"]) ++mismatches;
+	CHECK(100 == t.row_number() && 0 == mismatches);
+}
+
+//selects go to the pool, a read nested in a read of the same thread shares its reader instead of waiting for
+//itself, and a dao without a pool still fails at once on a locked database
+void reader_pool_reads()
+{
+	scratch_database s;
+	table_adapter(s.database, L"pooled").create_table(L"id integer primary key");
+	auto d = make_shared<dao>();
+	d->open(s.path, L"", 1);
+	table_adapter a(d, L"pooled");
+	for(int i = 0; i < 3; ++i)
+		a += Values("id", i);
+	table t;
+	int outer = 0, inner = 0;
+	a >> std::function<bool(const cursor::row&)>([&](const cursor::row&)
+	{
+		++outer;
+		a >> t;
+		inner += t.row_number();
+		return true;
+	});
+	CHECK(3 == outer && 9 == inner);
+	CHECK(d->pool_stats().reader_acquisitions >= 4 && 0 == d->pool_stats().reader_waits);
+
+	auto c = d->query(command(L"select * from pooled"));
+	d->close();
+	int rows = 0;
+	while(c->next()) ++rows;
+	CHECK(3 == rows);
+	c.reset();
+
+	sqlite3* blocker = nullptr;
+	sqlite3_open(s.path.string().c_str(), &blocker);
+	sqlite3_exec(blocker, "begin immediate;", 0, 0, nullptr);
+	auto started = std::chrono::steady_clock::now();
+	table_adapter(s.database, L"pooled") += Values("id", 3);
+	CHECK(std::chrono::steady_clock::now() - started < std::chrono::seconds(1));
+	sqlite3_exec(blocker, "rollback;", 0, 0, nullptr);
+	sqlite3_close(blocker);
+}
+
+//keyset paging returns every row once, by a key that is selected or not, including rowid, and keeps an or in the
+//where clause inside the seek
+void keyset_pages()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"paged");
+	a.create_table(L"id integer primary key, name text, kind int");
+	for(int i = 0; i < 7; ++i)
+		a += Values("id", i)("name", L"name " + std::to_wstring(i))("kind", i % 3);
+
+	auto count_pages = [](const table_adapter& adapter, const wstring& key, int& rows)
+	{
+		table t;
+		page_token token;
+		int pages = 0;
+		rows = 0;
+		do
+		{
+			token = adapter.next_page(key, 3, t, token);
+			rows += t.row_number();
+			++pages;
+		} while(false == token.finished);
+		return pages;
+	};
+	int rows = 0;
+	CHECK(3 == count_pages(a, L"id", rows) && 7 == rows);
+	CHECK(3 == count_pages(a, L"rowid", rows) && 7 == rows);
+	CHECK(3 == count_pages(a(L"name"), L"id", rows) && 7 == rows);
+	count_pages(a[L"kind = 0 or kind = 1"], L"id", rows);
+	CHECK(5 == rows);
+
+	table t;
+	a(L"name").next_page(L"id", 3, t);
+	wstring name = t[0]["name"];
+	CHECK(1 == t.column_number() && L"name 0" == name);
+}
+
+//an upsert on declared conflict columns inserts new rows, updates existing ones and keeps the columns it is not given
+void upsert_keeps_other_columns()
+{
+	scratch_database s;
+	table_adapter a(s.database, L"counters");
+	a.create_table(L"id integer primary key, name text, n int");
+	a += Values("id", 1)("name", L"x")("n", 1);
+	auto keyed = a.on_conflict(L"id");
+	keyed |= Values("id", 1)("n", 7);
+	keyed |= Values("id", 2)("n", 3);
+	table t;
+	a >> t;
+	wstring name = t[0]["name"];
+	CHECK(2 == t.row_number() && L"x" == name && 7 == (int64_t)t[0]["n"] && 3 == (int64_t)t[1]["n"]);
+
+	vector<mapped_table> rows;
+	rows.push_back(Values("id", 2)("name", L"two"));
+	rows.push_back(Values("id", 3)("name", L"three"));
+	keyed.insert_many(rows);
+	a >> t;
+	name = t[1]["name"].to<wstring>();
+	CHECK(3 == t.row_number() && L"two" == name && 3 == (int64_t)t[1]["n"]);
+
+	keyed[L"n > 5"] |= Values("id", 2)("name", L"skipped");
+	keyed[L"n > 5"] |= Values("id", 1)("name", L"one");
+	a >> t;
+	wstring first = t[0]["name"], second = t[1]["name"];
+	CHECK(3 == t.row_number() && L"one" == first && L"two" == second);
+}
+
+void run(const char* name, void(*test)())
+{
+	try
+	{
+		test();
+	}
+	catch(...)
+	{
+		++g_failures;
+		cout << name << ": unexpected exception" << endl;
+	}
+}
+
+int main()
+{
+	run("statement_cache_reuse", statement_cache_reuse);
+	run("cursor_streams_rows", cursor_streams_rows);
+	run("cursor_row_accessors", cursor_row_accessors);
+	run("record_mapping_round_trip", record_mapping_round_trip);
+	run("async_calls", async_calls);
+	run("text_round_trip", text_round_trip);
+	run("columnar_types", columnar_types);
+	run("arena_backed_table", arena_backed_table);
+	run("column_handles", column_handles);
+	run("statement_profiles", statement_profiles);
+	run("indexed_and_borrowed_binds", indexed_and_borrowed_binds);
+	run("typed_predicates", typed_predicates);
+	run("compiled_query_parameters", compiled_query_parameters);
+	run("value_kinds", value_kinds);
+	run("result_cache_snapshots", result_cache_snapshots);
+	run("change_feed_events", change_feed_events);
+	run("import_across_buffer_boundaries", import_across_buffer_boundaries);
+	run("import_stray_quotes", import_stray_quotes);
+	run("import_progress_calls", import_progress_calls);
+	run("arrow_export_types", arrow_export_types);
+#if SQLITE_VERSION_NUMBER >= 3004000
+	run("blob_stream_round_trip", blob_stream_round_trip);
+#endif
+	run("drop_with_result_cache", drop_with_result_cache);
+	run("changes_published_after_commit", changes_published_after_commit);
+	run("grouped_write_outlives_dao", grouped_write_outlives_dao);
+	run("failed_grouped_write_rolls_back", failed_grouped_write_rolls_back);
+	run("compiled_query_limits", compiled_query_limits);
+	run("insert_many_rows", insert_many_rows);
+	run("reader_pool_reads", reader_pool_reads);
+	run("keyset_pages", keyset_pages);
+	run("upsert_keeps_other_columns", upsert_keeps_other_columns);
+	cout << (g_failures ? "failed" : "passed") << endl;
+	return g_failures;
+}